@@ -25,6 +25,24 @@ struct Open opentab[MAXOPEN] = { { 0, 0, 1 } };			// 文件打开记录表
 // Virtual address at which to receive page mappings containing client requests.
 #define REQVA	0x0ffff000
 
+// Shared executable images: private snapshots of recently spawned programs,
+// one PDMAP window (>= MAXFILESIZE) each, mapped read-only into the
+// clients that open them with O_EXEC. A snapshot is dropped as soon as its
+// file is written, truncated or removed; clients that already map it keep
+// their pages, new ones get a fresh copy of the file.
+struct Exec {
+	struct File *e_file;	// file the snapshot was taken from, 0 if free
+	u_int e_npages;			// pages in the snapshot
+	u_int e_stamp;			// last use, for eviction
+};
+
+#define NEXEC			16
+#define EXECVA			0x50000000
+#define exec2va(e)		(EXECVA + ((e) - exectab) * PDMAP)
+
+struct Exec exectab[NEXEC];
+u_int exec_clock;
+
 // Overview:
 //	Initialize file system server process.
 void
@@ -87,6 +105,69 @@ open_lookup(u_int envid, u_int fileid, struct Open **po)
 	return 0;
 }
 
+// Overview:
+//	Drop the executable snapshot of `f`, if there is one.
+void
+exec_invalidate(struct File *f)
+{
+	struct Exec *e;
+
+	for (e = exectab; e < &exectab[NEXEC]; e++) {
+		if (e->e_file == f) {
+			syscall_mem_unmap_range(0, exec2va(e), e->e_npages);
+			e->e_file = 0;
+		}
+	}
+}
+
+// Overview:
+//	Find the executable snapshot of `f`, taking one if there is none
+//	(evicting the least recently used when the table is full).
+int
+exec_lookup(struct File *f, struct Exec **pe)
+{
+	struct Exec *e, *victim;
+	u_int i, npages;
+	void *blk;
+	int r;
+
+	victim = exectab;
+	for (e = exectab; e < &exectab[NEXEC]; e++) {
+		if (e->e_file == f) {
+			e->e_stamp = ++exec_clock;
+			*pe = e;
+			return 0;
+		}
+		if (victim->e_file != 0 &&
+			(e->e_file == 0 || e->e_stamp < victim->e_stamp)) {
+			victim = e;
+		}
+	}
+
+	e = victim;
+	if (e->e_file != 0) {
+		exec_invalidate(e->e_file);
+	}
+
+	npages = ROUND(f->f_size, BY2PG) / BY2PG;
+	if ((r = syscall_mem_alloc_range(0, exec2va(e), npages, PTE_V | PTE_R)) < 0) {
+		return r;
+	}
+	for (i = 0; i < npages; i++) {
+		if ((r = file_get_block(f, i, &blk)) < 0) {
+			syscall_mem_unmap_range(0, exec2va(e), npages);
+			return r;
+		}
+		user_bcopy(blk, (void *)(exec2va(e) + i * BY2PG), BY2PG);
+	}
+
+	e->e_file = f;
+	e->e_npages = npages;
+	e->e_stamp = ++exec_clock;
+	*pe = e;
+	return 0;
+}
+
 // Serve requests, sending responses back to envid.
 // To send a result back, ipc_send(envid, r, 0, 0).
 // To include a page, ipc_send(envid, r, srcva, perm).
@@ -115,8 +196,16 @@ serve_open(u_int envid, struct Fsreq_open *rq)
 
 	fileid = r;
 
-	// Open the file.
-	if ((r = file_open((char *)path, &f)) < 0) {
+	// Open the file, creating or emptying it if asked to.
+	r = file_open((char *)path, &f);
+	if (r == -E_NOT_FOUND && (rq->req_omode & O_CREAT)) {
+		r = file_create((char *)path, &f);
+	}
+	if (r == 0 && (rq->req_omode & O_TRUNC)) {
+		exec_invalidate(f);
+		r = file_set_size(f, 0);
+	}
+	if (r < 0) {
 	//	user_panic("file_open failed: %d, invalid path: %s", r, path);
 		ipc_send(envid, r, 0, 0);
 		return ;
@@ -173,6 +262,7 @@ serve_set_size(u_int envid, struct Fsreq_set_size *rq)
 		return;
 	}
 
+	exec_invalidate(pOpen->o_file);
 	if ((r = file_set_size(pOpen->o_file, rq->req_size)) < 0) {
 		ipc_send(envid, r, 0, 0);
 		return;
@@ -204,10 +294,14 @@ serve_remove(u_int envid, struct Fsreq_remove *rq)
 {
 	int r = 0;
 	u_char path[MAXPATHLEN];
+	struct File *f;
 
 	// Step 1: Copy in the path, making sure it's terminated.
 	user_bcopy(rq->req_path, path, MAXPATHLEN);
 	path[MAXPATHLEN - 1] = 0;
+	if (file_open((char *)path, &f) == 0) {
+		exec_invalidate(f);
+	}
 	// Step 2: Remove file from file system and response to user-level process.
 	r = file_remove(path);
 	if(r<0) {
@@ -229,6 +323,7 @@ serve_dirty(u_int envid, struct Fsreq_dirty *rq)
 		return;
 	}
 
+	exec_invalidate(pOpen->o_file);
 	if ((r = file_dirty(pOpen->o_file, rq->req_offset)) < 0) {
 		ipc_send(envid, r, 0, 0);
 		return;
@@ -237,6 +332,36 @@ serve_dirty(u_int envid, struct Fsreq_dirty *rq)
 	ipc_send(envid, 0, 0, 0);
 }
 
+// Overview:
+//	Map the executable snapshot of an O_EXEC open file read-only at
+//	`rq->req_dstva` in the client, all pages in one call.
+void
+serve_map_exec(u_int envid, struct Fsreq_map_exec *rq)
+{
+	struct Open *pOpen;
+	struct Exec *e;
+	int r;
+
+	if ((r = open_lookup(envid, rq->req_fileid, &pOpen)) < 0) {
+		ipc_send(envid, r, 0, 0);
+		return;
+	}
+
+	if ((pOpen->o_mode & (O_ACCMODE | O_EXEC)) != (O_RDONLY | O_EXEC)) {
+		ipc_send(envid, -E_INVAL, 0, 0);
+		return;
+	}
+
+	if ((r = exec_lookup(pOpen->o_file, &e)) < 0) {
+		ipc_send(envid, r, 0, 0);
+		return;
+	}
+
+	r = syscall_mem_map_range(exec2va(e), envid, rq->req_dstva, e->e_npages,
+							  PTE_V | PTE_LIBRARY);
+	ipc_send(envid, r < 0 ? r : 0, 0, 0);
+}
+
 void
 serve_sync(u_int envid)
 {
@@ -290,6 +415,10 @@ serve(void)
 				serve_sync(whom);
 				break;
 
+			case FSREQ_MAP_EXEC:
+				serve_map_exec(whom, (struct Fsreq_map_exec *)REQVA);
+				break;
+
 			default:
 				writef("Invalid request code %d from %08x\n", whom, req);
 				break;
@@ -7,17 +7,54 @@
 #include "queue.h"
 #include "trap.h"
 #include "mmu.h" 
+#include "timer.h"
 
 #define LOG2NENV	10
 #define NENV		(1<<LOG2NENV)
 #define ENVX(envid)	((envid) & (NENV - 1))
-#define GET_ENV_ASID(envid) (((envid)>> 11)<<6)
+
+// ASIDs are handed out by env_asid_alloc. env_asid holds the ASID in its low
+// bits and the generation it was given in above them; an ASID from an older
+// generation is stale and the env gets a new one when it next runs.
+#define NASID		64
+#define ASID_MASK	(NASID - 1)
+#define ENV_ASID(e)	(((e)->env_asid & ASID_MASK) << 6)	// as in EntryHi
+
+// The env owning a page directory, as noted in the struct Page of the
+// directory; 0 for boot_pgdir. Needs pmap.h.
+#define pgdir2env(pgdir)	(pa2page(PADDR(pgdir))->pp_env)
+
+// Count `n` more (or, negative, fewer) resident pages for the owner of
+// `pgdir`, if it has one.
+#define pgdir_rss_add(pgdir, n)	do { \
+	struct Env *_e = pgdir2env(pgdir); \
+	if (_e) { \
+		_e->env_rss += (n); \
+	} \
+} while (0)
+
+#define timer2env(t)	\
+	((struct Env *)((u_long)(t) - (u_long)&((struct Env *)0)->env_timer))
 
 // Values of env_status in struct Env
 #define ENV_FREE	0
 #define ENV_RUNNABLE		1
 #define ENV_NOT_RUNNABLE	2
 
+// A demand-zero region: a page of [vr_start, vr_end) that is touched
+// before anything is mapped there gets a fresh zeroed page with vr_perm.
+struct Vmregion {
+	u_long vr_start;
+	u_long vr_end;
+	u_int vr_perm;
+	LIST_ENTRY(Vmregion) vr_link;
+};
+LIST_HEAD(Vmregion_list, Vmregion);
+
+#define ENV_NREGION		16		// most regions an env can register
+#define ENV_STACK_LIMIT	256		// default stack size limit, in pages
+#define ENV_MEM_UNLIMITED	(~0u)	// default env_mem_limit
+
 struct Env {
 	struct Trapframe env_tf;        // Saved registers
 	LIST_ENTRY(Env) env_link;       // Free list
@@ -26,6 +63,7 @@ struct Env {
 	u_int env_status;               // Status of the environment
 	Pde  *env_pgdir;                // Kernel virtual address of page dir
 	u_int env_cr3;
+	u_int env_asid;                 // ASID and generation, see env_asid_alloc
 	LIST_ENTRY(Env) env_sched_link;
         u_int env_pri;
 	// Lab 4 IPC
@@ -38,13 +76,58 @@ struct Env {
 	// Lab 4 fault handling
 	u_int env_pgfault_handler;      // page fault state
 	u_int env_xstacktop;            // top of exception stack
+	u_int env_kcow;                 // resolve COW faults in the kernel
+
+	// Demand-zero memory: the stack below USTACKTOP, up to env_stack_limit
+	// pages, and whatever regions were registered (bss, heap, ...)
+	struct Vmregion_list env_regions;
+	u_int env_stack_limit;
+
+	// Memory accounting: pages mapped in the user part of the address
+	// space (a shared page counts in every env that maps it) and pages out
+	// on the swap disk. Their sum may not grow past env_mem_limit.
+	u_int env_rss;
+	u_int env_nswap;
+	u_int env_mem_limit;
+
+	// Wakes the env up from sys_sleep, or from sys_ipc_recv with a timeout
+	struct Timer env_timer;
 
 	// Lab 6 scheduler counts
 	u_int env_runs;			// number of times been env_run'ed
+	u_int env_pass;			// stride scheduling: CPU used / tickets
+	u_int env_cpu_sec;		// CPU time used
+	u_int env_cpu_usec;
+	u_int env_donor;		// envid whose share we run on, see sched_lend
+	u_int env_tlb_misses;		// TLB refills taken while running
+
+	// Syscall accounting, see include/sysstat.h
+	struct Sysstat *env_sysstat;	// one per syscall number, 0 until needed
+	u_int env_sys_stamp;		// when the syscall under way began
+
+	struct Uinfo *env_info;		// kernel address of its info page
 	u_int env_nop;                  // align to avoid mul instruction
 };
 
 LIST_HEAD(Env_list, Env);
+
+/*
+ * The info page, mapped read-only at UINFO in each env: facts about the
+ * env itself, so that user code need not trap to learn them. The kernel
+ * brings it up to date whenever the env is switched to and on every clock
+ * tick. ui_seq works like tp_seq on the time page (see kclock.h).
+ */
+struct Uinfo {
+	volatile u_int ui_seq;
+	u_int ui_envid;
+	u_int ui_parent_id;
+	u_int ui_ticks;				// kclock_ticks at the last update
+	u_int ui_runs;				// times it was switched to
+	u_int ui_cpu_sec;			// CPU time used, as of the last update
+	u_int ui_cpu_usec;
+	u_int ui_tickets;			// its share, see sched.h
+	u_int ui_tlb_misses;
+};
 extern struct Env *envs;		// All environments
 extern struct Env *curenv;	        // the current env
 extern struct Env_list env_sched_list[2]; // runnable env list
@@ -55,9 +138,18 @@ void env_free(struct Env *);
 void env_create_priority(u_char *binary, int size, int priority);
 void env_create(u_char *binary, int size);
 void env_destroy(struct Env *e);
+int env_reap(u_int n);
+int env_region_add(struct Env *e, u_long va, u_int npages, u_int perm);
+void env_region_clear(struct Env *e, u_long va, u_int npages);
+int env_region_copy(struct Env *dst, struct Env *src);
+int env_region_lookup(struct Env *e, u_long va, u_int *perm);
+int env_mem_check(struct Env *e, u_int npages);
+void env_info_update(struct Env *e);
 
 int envid2env(u_int envid, struct Env **penv, int checkperm);
 void env_run(struct Env *e);
+void env_clear_curenv(void);
+void env_asid_alloc(struct Env *e);
 
 
 // for the grading script
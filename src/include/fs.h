@@ -62,6 +62,7 @@ struct Super {
 #define FSREQ_DIRTY	5
 #define FSREQ_REMOVE	6
 #define FSREQ_SYNC	7
+#define FSREQ_MAP_EXEC	8
 
 struct Fsreq_open {
 	char req_path[MAXPATHLEN];
@@ -91,4 +92,9 @@ struct Fsreq_remove {
 	u_char req_path[MAXPATHLEN];
 };
 
+struct Fsreq_map_exec {
+	int req_fileid;
+	u_int req_dstva;
+};
+
 #endif // _FS_H_
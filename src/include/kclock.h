@@ -2,8 +2,45 @@
 
 #ifndef _KCLOCK_H_
 #define _KCLOCK_H_
-#define	IO_RTC		0xb5000100		/* RTC port */
+#define	IO_RTC_TRIGGER	0xb5000000	/* RTC port: latch the current time */
+#define	IO_RTC_SEC	0xb5000010		/* RTC port: latched seconds */
+#define	IO_RTC_USEC	0xb5000020		/* RTC port: latched microseconds */
+#define	IO_RTC		0xb5000100		/* RTC port: ticks per second, 0 stops them */
+#define	IO_RTC_ACK	0xb5000110		/* RTC port: acknowledge a tick */
+
+/* Clock ticks per second; build with -DHZ=n to change it. */
+#ifndef HZ
+#define HZ		1
+#endif
+
 #ifndef __ASSEMBLER__
+#include "types.h"
+
+/*
+ * The time page, mapped read-only at UTIME in every env. The kernel
+ * rewrites it on every clock tick and context switch, so user code can
+ * read the time without a syscall. tp_seq is odd while an update is under
+ * way: a reader that sees it odd, or changed across its read, retries.
+ */
+struct Timepage {
+	volatile u_int tp_seq;
+	u_int tp_hz;				// clock ticks per second
+	u_int tp_ticks;				// kclock_ticks at the last update
+	u_int tp_sec;				// time since boot at the last update,
+	u_int tp_usec;				// never going backwards
+};
+
+extern volatile u_int kclock_ticks;
+extern struct Timepage *timepage;
+
 void kclock_init(void);
+void kclock_set_hz(u_int hz);
+void kclock_tick(void);
+void kclock_suspend(void);
+void kclock_resume(void);
+int kclock_pending(void);
+void kclock_update(void);
+void kclock_now(u_int *sec, u_int *usec);
+u_int kclock_us(void);
 #endif /* !__ASSEMBLER__ */
 #endif
@@ -0,0 +1,52 @@
+#ifndef _KMEM_H_
+#define _KMEM_H_
+
+#include "types.h"
+#include "pmap.h"
+
+/*
+ * Kernel object caches.
+ *
+ * A page cache keeps whole pages (page tables, page directories) that
+ * have been given back in their constructed state, so the next user can
+ * take them as they are instead of going through page_alloc and bzero.
+ * kmem_reap returns the pages to the page allocator when memory runs
+ * short.
+ *
+ * An object cache hands out small fixed-size objects carved out of
+ * pages. An object is constructed once, when its page is carved, and must
+ * be given back in the same state.
+ */
+
+struct Kmem_pgcache {
+	const char *kp_name;
+	struct Page_list kp_list;	// cached pages, linked through pp_link
+	u_int kp_n;					// pages on kp_list
+	u_int kp_max;				// most pages to keep
+	void (*kp_ctor)(void *va);	// builds a fresh page, 0 if bzero will do
+	struct Kmem_pgcache *kp_next;
+};
+
+struct Kmem_cache {
+	const char *kc_name;
+	u_int kc_size;				// object size plus the free-list link
+	void (*kc_ctor)(void *obj);
+	void *kc_free;				// free objects
+	u_int kc_nfree;
+	u_int kc_npages;			// pages carved so far
+};
+
+extern struct Kmem_pgcache kmem_pgtables;
+
+void kmem_init(void);
+void kmem_pgcache_init(struct Kmem_pgcache *kp, const char *name, u_int max,
+					   void (*ctor)(void *va));
+int kmem_page_alloc(struct Kmem_pgcache *kp, struct Page **pp);
+void kmem_page_put(struct Kmem_pgcache *kp, struct Page *pp);
+void kmem_cache_init(struct Kmem_cache *kc, const char *name, u_int size,
+					 void (*ctor)(void *obj));
+void *kmem_cache_alloc(struct Kmem_cache *kc);
+void kmem_cache_free(struct Kmem_cache *kc, void *obj);
+int kmem_reap(void);
+
+#endif /* _KMEM_H_ */
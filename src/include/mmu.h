@@ -39,6 +39,9 @@
 #define PTE_COW		0x0001	// Copy On Write
 #define PTE_UC		0x0800	// unCached
 #define PTE_LIBRARY		0x0004	// share memmory
+#define PTE_SWAP	0x0008	// Not present: the page is on the swap disk (see swap.h)
+#define PTE_A		0x0010	// Referenced since the page reclaimer last looked
+#define PTE_USER	(PTE_V | PTE_R | PTE_D | PTE_LIBRARY | PTE_UC)	// Bits a syscall may ask for
 /*
  * Part 2.  Our conventions.
  */
@@ -63,7 +66,9 @@
  o      ULIM     -----> +----------------------------+------------0x8000 0000-------    
  o                      |         User VPT           |     PDMAP                /|\ 
  o      UVPT     -----> +----------------------------+------------0x7fc0 0000    |
- o                      |         PAGES              |     PDMAP                 |
+ o                      |         TIME               |     BY2PG                 |
+ o      UTIME    -----> +----------------------------+------------0x7fbf f000    |
+ o                      |         PAGES              |     PDMAP - BY2PG         |
  o      UPAGES   -----> +----------------------------+------------0x7f80 0000    |
  o                      |         ENVS               |     PDMAP                 |
  o  UTOP,UENVS   -----> +----------------------------+------------0x7f40 0000    |
@@ -80,8 +85,10 @@
  a                      .                            .                           |
  a                      |~~~~~~~~~~~~~~~~~~~~~~~~~~~~|                           |
  a                      |                            |                           |
- o       UTEXT   -----> +----------------------------+                           |
- o                      |                            |     2 * PDMAP            \|/
+ o       UTEXT   -----> +----------------------------+------------0x0040 0000    |
+ o                      |         INFO               |     BY2PG                 |
+ o       UINFO   -----> +----------------------------+------------0x003f f000    |
+ o                      |                            |     2 * PDMAP - BY2PG    \|/
  a     0 ------------>  +----------------------------+ -----------------------------
  o
 */
@@ -95,6 +102,7 @@
 
 #define UVPT (ULIM - PDMAP)
 #define UPAGES (UVPT - PDMAP)
+#define UTIME (UVPT - BY2PG)
 #define UENVS (UPAGES - PDMAP)
 
 #define UTOP UENVS
@@ -103,6 +111,7 @@
 
 #define USTACKTOP (UTOP - 2*BY2PG)
 #define UTEXT 0x00400000
+#define UINFO (UTEXT - BY2PG)
 
 
 #define E_UNSPECIFIED	1	// Unspecified or unknown problem
@@ -121,8 +130,9 @@
 #define E_BAD_PATH	10	// Bad path
 #define E_FILE_EXISTS	11	// File already exists
 #define E_NOT_EXEC	12	// File not a valid executable
+#define E_TIMEOUT	13	// A wait ran out of time
 
-#define MAXERROR 12
+#define MAXERROR 13
 
 #ifndef __ASSEMBLER__
 
@@ -173,5 +183,6 @@ extern volatile Pde* vpd[];
 
 
 extern void tlb_out(u_int entryhi);
+extern void tlb_write(u_int entryhi, u_int entrylo);
 #endif //!__ASSEMBLER__
 #endif // !_MMU_H_
@@ -5,6 +5,7 @@
 #include "queue.h"
 #include "mmu.h"
 #include "printf.h"
+#include "trap.h"
 
 
 LIST_HEAD(Page_list, Page);
@@ -19,8 +20,27 @@ struct Page {
 	// do not have valid reference count fields.
 
 	u_short pp_ref;
+
+	// Buddy allocator state: pp_free is set only on the first page of a
+	// free block, whose size is (1 << pp_order) pages.
+	u_char pp_order;
+	u_char pp_free;
+
+	// On the page directory of an env, that env (see pgdir2env).
+	struct Env *pp_env;
 };
 
+// Free blocks come in PAGE_NORDER sizes: 1, 2, 4, ... 1024 pages.
+#define PAGE_NORDER	11
+
+// Most pages kept zeroed ahead of time, and how many to zero per idle call.
+#define PAGE_NZERO	64
+#define PAGE_ZERO_BATCH	4
+
+// Above this many pages, invalidating a range sweeps the TLB for the ASID
+// instead of probing it page by page.
+#define TLB_RANGE_MAX	16
+
 extern struct Page *pages;
 static inline u_long
 page2ppn(struct Page *pp)
@@ -71,13 +91,31 @@ void mips_init();
 void page_init(void);
 void page_check();
 int page_alloc(struct Page **pp);
+int page_alloc_nozero(struct Page **pp);
+int page_alloc_order(struct Page **pp, u_int order);
 void page_free(struct Page *pp);
+void page_free_order(struct Page *pp, u_int order);
+void page_free_report(void);
+void page_zero_refill(u_int n);
 void page_decref(struct Page *pp);
 int pgdir_walk(Pde *pgdir, u_long va, int create, Pte **ppte);
 int page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm);
 struct Page* page_lookup(Pde *pgdir, u_long va, Pte **ppte);
 void page_remove(Pde *pgdir, u_long va) ;
+int page_cow(Pde *pgdir, u_long va);
+int copyout(u_long va, const void *src, u_int len);
+int copyin(void *dst, u_long va, u_int len);
 void tlb_invalidate(Pde *pgdir, u_long va);
+void tlb_flush_all(void);
+void tlb_flush_asid(u_int asid);
+void tlb_invalidate_pgdir(Pde *pgdir);
+void tlb_invalidate_range(Pde *pgdir, u_long va, u_int npages);
+int page_alloc_range(Pde *pgdir, u_long va, u_int npages, u_int perm);
+int page_map_range(Pde *srcpgdir, u_long srcva, Pde *dstpgdir, u_long dstva,
+                   u_int npages, u_int perm);
+int page_remove_range(Pde *pgdir, u_long va, u_int npages);
+
+void do_refill(struct Trapframe *tf);
 
 void boot_map_segment(Pde *pgdir, u_long va, u_long size, u_long pa, int perm);
 
@@ -0,0 +1,36 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * The sampling profiler. While it is on, every clock interrupt that
+ * catches an env in user mode counts one sample against (env, pc) in a
+ * fixed hash table; SYS_prof_ctl reads the counts back out. Samples come
+ * at the tick rate, so build with a larger HZ for a useful profile.
+ */
+
+#define PROF_NSLOT		2048	// distinct (env, pc) pairs kept
+#define PROF_PROBE		8		// slots tried before a sample is dropped
+
+/* SYS_prof_ctl operations. */
+#define PROF_START		1		// clear the counts and start sampling
+#define PROF_STOP		2		// stop; returns the samples dropped
+#define PROF_READ		3		// copy out counts, skipping the first `arg`
+
+#ifndef __ASSEMBLER__
+#include "types.h"
+
+struct Profrec {
+	u_int pr_envid;
+	u_int pr_pc;
+	u_int pr_count;				// samples taken there
+};
+
+extern int prof_on;
+
+void prof_sample(u_int pc);
+void prof_start(void);
+u_int prof_stop(void);
+int prof_read(u_int skip, u_long va, u_int n);
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _PROF_H_ */
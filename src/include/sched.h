@@ -3,8 +3,29 @@
 #ifndef __SCHED_H__
 #define __SCHED_H__
 
+#include "kclock.h"
+
+// Stride scheduling: an env holds env_pri tickets (at least one), and its
+// pass advances by the CPU time it uses divided by its tickets. The
+// runnable env with the lowest pass runs next, so CPU time is shared in
+// proportion to tickets.
+#define SCHED_TICKETS(e)	((e)->env_pri ? (e)->env_pri : 1)
+
+// Most a waking env's pass may lag behind sched_vtime, in microseconds of
+// CPU: sleeping earns no more credit than one tick.
+#define SCHED_MAX_LAG	(1000000 / HZ)
+
+struct Env;
+
+extern unsigned int sched_vtime;
+
 void sched_init(void);
 void sched_yield(void);
+void sched_charge(void);
+void sched_defer(struct Env *e);
+struct Env *sched_ctx(struct Env *e);
+void sched_lend(struct Env *from, struct Env *to);
+void sched_tick(void);
 void sched_intr(int); 
 
 #endif /* __SCHED_H__ */
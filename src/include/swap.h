@@ -0,0 +1,31 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+#include "types.h"
+#include "mmu.h"
+
+/*
+ * Swapping anonymous pages out to a disk of their own.
+ *
+ * A page that has been swapped out leaves a non-present entry behind in
+ * its page table: PTE_V is clear, PTE_SWAP is set, the PFN field holds the
+ * swap slot and the low bits keep the permission the page had. The TLB
+ * refill handler sets PTE_A whenever it loads an entry, and the reclaimer
+ * sweeps the address spaces like the hand of a clock: a page whose PTE_A
+ * is set gets a second chance, one whose PTE_A is still clear on the next
+ * pass is written out.
+ */
+
+#define SWAP_DISKNO		1		// gxemul disk holding the swap area
+#define SWAP_NSLOT		4096	// page-sized slots on it (16 MB)
+#define SWAP_CLUSTER	16		// pages to reclaim per call
+
+#define PTE_ISSWAP(pte)	(((pte) & (PTE_V | PTE_SWAP)) == PTE_SWAP)
+#define SWAP_SLOT(pte)	PPN(pte)
+
+void swap_init(void);
+int swap_reclaim(u_int n);
+int swap_in(Pde *pgdir, u_long va, Pte *pte);
+void swap_free(Pde *pgdir, Pte pte);
+
+#endif /* _SWAP_H_ */
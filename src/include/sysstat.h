@@ -0,0 +1,22 @@
+#ifndef _SYSSTAT_H_
+#define _SYSSTAT_H_
+
+#include "types.h"
+#include "unistd.h"
+
+/*
+ * Syscall accounting, always on: handle_sys (lib/syscall.S) counts every
+ * call on the way in and times it on the way out, into a table for the
+ * whole system and one per env. A struct Sysstat per syscall number; see
+ * include/unistd.h.
+ */
+
+struct Env;
+
+void sysstat_init(void);
+void sysstat_enter(u_int n);
+void sysstat_exit(u_int sysno, int ret);
+void sysstat_free(struct Env *e);
+int sysstat_read(struct Env *e, u_long va, u_int n);
+
+#endif /* _SYSSTAT_H_ */
@@ -0,0 +1,31 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include "types.h"
+#include "queue.h"
+
+/*
+ * Kernel timers, kept in a hashed timer wheel: a timer due at tick t sits
+ * on slot t % TIMER_NSLOT, so each clock tick only looks at one short
+ * list. A timer further away than one turn of the wheel simply stays on
+ * its slot for more turns.
+ */
+
+#define TIMER_NSLOT	64
+
+struct Timer {
+	u_int t_expires;				// kclock_ticks value it is due at
+	void (*t_fn)(struct Timer *t);	// called from the clock interrupt
+	u_int t_armed;
+	LIST_ENTRY(Timer) t_link;
+};
+LIST_HEAD(Timer_list, Timer);
+
+extern u_int timer_npending;
+
+void timer_set(struct Timer *t, u_int ticks, void (*fn)(struct Timer *t));
+void timer_cancel(struct Timer *t);
+void timer_run(void);
+u_int timer_ms2ticks(u_int ms);
+
+#endif /* _TIMER_H_ */
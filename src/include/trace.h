@@ -0,0 +1,62 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * The kernel event trace: a ring of the last TRACE_NREC scheduler, IPC,
+ * fault and syscall events, each stamped with kclock_us(). Tracing is off
+ * until an env turns it on with SYS_trace_ctl; records are then read out
+ * oldest first, and once the ring is full the oldest unread ones are
+ * overwritten (and counted as lost).
+ */
+
+#define TRACE_NREC		1024
+
+/* Events: what tr_envid did, and what tr_arg[] hold. */
+#define TR_SWITCH		1		// switched to; arg0: the env switched from
+#define TR_BLOCK		2		// stopped running; arg0: TRB_* reason
+#define TR_WAKE			3		// made runnable; arg0: by whom (0: a timer)
+#define TR_IPC_SEND		4		// sent; arg0: to whom, arg1: the value
+#define TR_IPC_RECV		5		// waits for a message; arg0: dstva
+#define TR_FAULT		6		// page fault; arg0: va, arg1: TRF_* kind
+#define TR_SYSCALL		7		// arg0: syscall number, arg1: return value
+
+#define TRB_SLEEP		1
+#define TRB_STATUS		2		// by sys_set_env_status
+
+#define TRF_COW			1		// write to a copy-on-write page
+#define TRF_ZERO		2		// first touch of demand-zero memory
+#define TRF_SWAP		3		// page was out on the swap disk
+#define TRF_USER		4		// write to a read-only page, left to the env's handler
+
+/* SYS_trace_ctl operations. */
+#define TRACE_START		1		// empty the ring and start recording
+#define TRACE_STOP		2
+#define TRACE_READ		3		// copy out the oldest unread records
+#define TRACE_LOST		4		// records overwritten before being read
+
+#ifndef __ASSEMBLER__
+#include "types.h"
+
+struct Tracerec {
+	u_int tr_usec;				// kclock_us() when it happened
+	u_int tr_type;
+	u_int tr_envid;
+	u_int tr_arg[2];
+};
+
+extern int trace_on;
+
+void trace_log(u_int type, u_int envid, u_int arg0, u_int arg1);
+void trace_syscall(u_int sysno, int ret);
+void trace_start(void);
+int trace_read(u_long va, u_int n);
+u_int trace_lost(void);
+
+#define TRACE(type, envid, arg0, arg1) do { \
+		if (trace_on) { \
+			trace_log((type), (envid), (u_int)(arg0), (u_int)(arg1)); \
+		} \
+	} while (0)
+#endif /* !__ASSEMBLER__ */
+
+#endif /* _TRACE_H_ */
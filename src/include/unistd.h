@@ -2,7 +2,7 @@
 #define UNISTD_H
 
 #define __SYSCALL_BASE 9527
-#define __NR_SYSCALLS 20
+#define __NR_SYSCALLS 31
 
 
 #define SYS_putchar 		((__SYSCALL_BASE ) + (0 ) ) 
@@ -22,5 +22,56 @@
 #define SYS_cgetc			((__SYSCALL_BASE ) + (14 ) )
 #define SYS_write_dev		((__SYSCALL_BASE ) + (15) )
 #define SYS_read_dev		((__SYSCALL_BASE ) + (16) )
+#define SYS_set_kernel_cow	((__SYSCALL_BASE ) + (17) )
+#define SYS_mem_alloc_range	((__SYSCALL_BASE ) + (18) )
+#define SYS_mem_map_range	((__SYSCALL_BASE ) + (19) )
+#define SYS_mem_unmap_range	((__SYSCALL_BASE ) + (20) )
+#define SYS_batch			((__SYSCALL_BASE ) + (21) )
+#define SYS_mem_region		((__SYSCALL_BASE ) + (22) )
+#define SYS_set_stack_limit	((__SYSCALL_BASE ) + (23) )
+#define SYS_set_mem_limit	((__SYSCALL_BASE ) + (24) )
+#define SYS_mem_stat		((__SYSCALL_BASE ) + (25) )
+#define SYS_sleep			((__SYSCALL_BASE ) + (26) )
+#define SYS_cpu_stat		((__SYSCALL_BASE ) + (27) )
+#define SYS_trace_ctl		((__SYSCALL_BASE ) + (28) )
+#define SYS_prof_ctl		((__SYSCALL_BASE ) + (29) )
+#define SYS_sys_stat		((__SYSCALL_BASE ) + (30) )
+
+#ifndef __ASSEMBLER__
+/* One record of a SYS_batch request: the syscall to run, its arguments,
+ * and (filled in by the kernel) its return value. */
+struct Sysbatch {
+	unsigned int sb_sysno;
+	unsigned int sb_args[5];
+	int sb_ret;
+};
+
+/* Memory use of an env, as reported by SYS_mem_stat (in pages). */
+struct Memstat {
+	unsigned int ms_rss;		// mapped in its address space
+	unsigned int ms_nswap;		// out on the swap disk
+	unsigned int ms_limit;		// cap on the two together
+};
+
+/* CPU use of an env, as reported by SYS_cpu_stat. */
+struct Cpustat {
+	unsigned int cs_sec;		// CPU time used
+	unsigned int cs_usec;
+	unsigned int cs_runs;		// times it was switched to
+	unsigned int cs_tickets;	// its share, see sched.h
+};
+
+/* Calls of one syscall, as reported by SYS_sys_stat: how many were made,
+ * and how long the ones that returned took. ss_hist[i] counts those that
+ * took less than 4^i microseconds (the last bucket, all the rest). */
+#define SYSSTAT_NBUCKET	8
+#define SYSSTAT_ALL		0xffffffff	// envid for the whole system
+
+struct Sysstat {
+	unsigned int ss_count;
+	unsigned int ss_usec;		// total time
+	unsigned int ss_hist[SYSSTAT_NBUCKET];
+};
+#endif
 
 #endif
@@ -1,9 +1,12 @@
 #include <asm/asm.h>
 #include <pmap.h>
+#include <kmem.h>
+#include <swap.h>
 #include <env.h>
 #include <printf.h>
 #include <kclock.h>
 #include <trap.h>
+#include <sysstat.h>
 
 extern char aoutcode[];
 extern char boutcode[];
@@ -16,8 +19,11 @@ void mips_init()
 	mips_vm_init();
 	page_init();
 	page_check();
+	kmem_init();
+	swap_init();
 	
 	env_init();
+	sysstat_init();
 	
 	//ENV_CREATE(user_fktest);
 	//ENV_CREATE(user_pt1);
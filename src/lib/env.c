@@ -7,14 +7,30 @@
 #include <kerelf.h>
 #include <sched.h>
 #include <pmap.h>
+#include <kmem.h>
+#include <swap.h>
+#include <kclock.h>
 #include <printf.h>
+#include <trace.h>
+#include <sysstat.h>
 
 struct Env *envs = NULL;		// All environments
 struct Env *curenv = NULL;	        // the current env
 
 static struct Env_list env_free_list;	// Free list
+static struct Env_list env_zombie_list;	// Destroyed, not yet freed (env_reap)
 struct Env_list env_sched_list[2];      // Runnable list
 
+// The TLB refill handler counts misses through this pointer (see env_run
+// and env_clear_curenv).
+static u_int tlb_miss_kernel;
+u_int *tlb_miss_count = &tlb_miss_kernel;
+
+static struct Kmem_cache region_cache;	// struct Vmregion
+
+static void pgdir_ctor(void *va);
+static struct Kmem_pgcache pgdir_cache;	// Page directories ready for use
+
 extern Pde *boot_pgdir;
 extern char *KERNEL_SP;
 extern int debug_mode;
@@ -98,6 +114,7 @@ env_init(void)
 	int i;
     /*Step 1: Initial env_free_list. */
 	LIST_INIT(&env_free_list);
+	LIST_INIT(&env_zombie_list);
 	LIST_INIT(&env_sched_list[0]);
 	LIST_INIT(&env_sched_list[1]);
     /*Step 2: Travel the elements in 'envs', init every element(mainly initial its status, mark it as free)
@@ -107,9 +124,49 @@ env_init(void)
 		LIST_INSERT_HEAD(&env_free_list, &envs[i], env_link);
 	}
 
+	kmem_pgcache_init(&pgdir_cache, "pgdir", 16, pgdir_ctor);
+	kmem_cache_init(&region_cache, "vmregion", sizeof(struct Vmregion), 0);
+
 }
 
 
+/* Overview:
+ *  Build a fresh page directory in the page at `va`: an empty user portion,
+ *  the kernel portion of boot_pgdir, and the VPT/UVPT self-mappings.
+ *  env_free leaves a page directory in exactly this state, so the pgdir
+ *  cache hands it to the next env as it is.
+ */
+static void
+pgdir_ctor(void *va)
+{
+	Pde *pgdir = va;
+	int i;
+
+    /*Step 1: Zero pgdir's field before UTOP. */
+	for(i=0;i<PDX(UTOP);i++) {
+		pgdir[i] = 0;
+	}
+
+    /*Step 2: Copy kernel's boot_pgdir to pgdir. */
+
+    /* Hint:
+     *  The VA space of all envs is identical above UTOP
+     *  (except at VPT and UVPT, which we've set below).
+     *  See ./include/mmu.h for layout.
+     *  Can you use boot_pgdir as a template?
+     */
+
+	/*Q: Why should we do this here?*/
+	for(; i <=PDX(~0); i++ ){
+		pgdir[i] = boot_pgdir[i];
+	}
+
+    /*VPT and UVPT map the env's own page table, with
+ *      *different permissions. */
+	pgdir[PDX(VPT)]   = PADDR(pgdir);					// virtual page table : only kernel
+	pgdir[PDX(UVPT)]  = PADDR(pgdir) | PTE_V | PTE_R;		// User virtual page table : User can get 
+}
+
 /* Overview:
  *  Initialize the kernel virtual memory layout for environment e.
  *  Allocate a page directory, set e->env_pgdir and e->env_cr3 accordingly,
@@ -121,50 +178,59 @@ static int
 env_setup_vm(struct Env *e)
 {
 
-	int i, r;
+	int r;
 	struct Page *p = NULL;
 	Pde *pgdir;
 
-	/*Step 1: Allocate a page for the page directory using a function you completed in the lab2.
+	/*Step 1: Get a page directory, already laid out by pgdir_ctor,
        * and add its reference.
        *pgdir is the page directory of Env e, assign value for it. */
-    if ((r = page_alloc(&p)) != 0 ) {/* Todo here*/
+    if ((r = kmem_page_alloc(&pgdir_cache, &p)) != 0 ) {
                 panic("env_setup_vm - page alloc error\n");
                 return r;
         }
 
 	p->pp_ref ++;
+	p->pp_env = e;		// see pgdir2env
 	pgdir = page2kva(p);
 
-    /*Step 2: Zero pgdir's field before UTOP. */
+    /*Step 2: Set e->env_pgdir and e->env_cr3 accordingly. */
+	e->env_pgdir = pgdir;
+	e->env_cr3 = PADDR(pgdir); // cr3: pa of pgdir
 
-	for(i=0;i<PDX(UTOP);i++) {
-		pgdir[i] = 0;
+    /*Step 3: Map its info page (see struct Uinfo) read-only at UINFO. The
+     * kernel keeps a reference of its own, so that the env unmapping the
+     * page cannot free it under env_info_update. */
+	if ((r = page_alloc(&p)) < 0 || (r = page_insert(pgdir, p, UINFO, 0)) < 0) {
+		panic("env_setup_vm - no memory for the info page\n");
+		return r;
 	}
+	p->pp_ref++;
+	e->env_info = (struct Uinfo *)page2kva(p);
+	return 0;
+}
 
-    /*Step 3: Copy kernel's boot_pgdir to pgdir. */
-
-    /* Hint:
-     *  The VA space of all envs is identical above UTOP
-     *  (except at VPT and UVPT, which we've set below).
-     *  See ./include/mmu.h for layout.
-     *  Can you use boot_pgdir as a template?
-     */
+/* Overview:
+ *  Bring the info page of `e` up to date.
+ */
+void
+env_info_update(struct Env *e)
+{
+	struct Uinfo *ui = e->env_info;
 
-	/*Q: Why should we do this here?*/
-	for(; i <=PDX(~0); i++ ){
-		pgdir[i] = boot_pgdir[i];
+	if (ui == NULL) {
+		return;
 	}
-
-    /*Step 4: Set e->env_pgdir and e->env_cr3 accordingly. */
-	e->env_pgdir = pgdir;
-	e->env_cr3 = PADDR(pgdir); // cr3: pa of pgdir
-
-    /*VPT and UVPT map the env's own page table, with
- *      *different permissions. */
-	e->env_pgdir[PDX(VPT)]   = e->env_cr3;					// virtual page table : only kernel
-    e->env_pgdir[PDX(UVPT)]  = e->env_cr3 | PTE_V | PTE_R;		// User virtual page table : User can get 
-	return 0;
+	ui->ui_seq++;
+	ui->ui_envid = e->env_id;
+	ui->ui_parent_id = e->env_parent_id;
+	ui->ui_ticks = kclock_ticks;
+	ui->ui_runs = e->env_runs;
+	ui->ui_cpu_sec = e->env_cpu_sec;
+	ui->ui_cpu_usec = e->env_cpu_usec;
+	ui->ui_tickets = SCHED_TICKETS(e);
+	ui->ui_tlb_misses = e->env_tlb_misses;
+	ui->ui_seq++;
 }
 
 /* Overview:
@@ -193,15 +259,19 @@ env_alloc(struct Env **new, u_int parent_id)
 	int r;
 	struct Env *e;
 
-    /*Step 1: Get a new Env from env_free_list*/
-	if(LIST_EMPTY(&env_free_list)){
+    /*Step 1: Get a new Env from env_free_list, freeing a destroyed one if
+     * that is all there is. */
+	if(LIST_EMPTY(&env_free_list) && env_reap(1) == 0){
 		return -E_NO_FREE_ENV;
 	} else {
 		e = LIST_FIRST(&env_free_list);
 	}
     
     /*Step 2: Call certain function(has been implemented) to init kernel memory layout for this new Env.
-     *The function mainly maps the kernel address to this new Env address. */
+     *The function mainly maps the kernel address to this new Env address.
+     *It maps the info page already, which counts in env_rss. */
+	e->env_rss = 0;
+	e->env_nswap = 0;
 	env_setup_vm(e);		// init the kernel mem layout and bzero the user mem layout
     /*Step 3: Initialize every field of new Env with appropriate values*/
 	e->env_id = mkenvid(e);
@@ -212,6 +282,20 @@ env_alloc(struct Env **new, u_int parent_id)
     e->env_tf.cp0_status = 0x10001004;
 	e->env_tf.regs[29] = USTACKTOP ;
 	e -> env_runs = 0;
+	e->env_pass = sched_vtime;	// start level with the running envs
+	e->env_cpu_sec = 0;
+	e->env_cpu_usec = 0;
+	e->env_donor = 0;
+	e->env_tlb_misses = 0;
+	e->env_pgfault_handler = 0;
+	e->env_xstacktop = 0;
+	e->env_kcow = 0;
+	e->env_asid = 0;		// generation 0 is never current
+	LIST_INIT(&e->env_regions);
+	e->env_stack_limit = ENV_STACK_LIMIT;
+	e->env_mem_limit = ENV_MEM_UNLIMITED;
+	e->env_timer.t_armed = 0;
+	env_info_update(e);
     /*Step 5: Remove the new Env from Env free list*/
 	*new = e;
 	LIST_REMOVE(e, env_link);
@@ -273,7 +357,7 @@ static int load_icode_mapper(u_long va, u_int32_t sgsize,
 
 
 		 /* Hint: You should alloc a page and increase the reference count of it. */
-		r = page_alloc(&p);
+		r = page_alloc_nozero(&p);		// overwritten in full just below
 		if(r<0) return r;
 		page_insert(pgdir, p, tempVa, PTE_R);	// reference increase here??
 		bcopy(bin+i, page2kva(p), BY2PG);
@@ -297,21 +381,12 @@ static int load_icode_mapper(u_long va, u_int32_t sgsize,
 		p->pp_ref ++;
 	}
 	// 这样会不会把一些没有用的东西也加载进去了呢？？？？
-	/*Step 2: alloc pages to reach `sgsize` when `bin_size` < `sgsize`.
-    * i has the value of `bin_size` now. */
-	while (i+BY2PG < sgsize) {
-		page_alloc(&p);
-		page_insert(pgdir, p, tempVa, PTE_R);
-		bzero(page2kva(p), BY2PG);
-		tempVa = tempVa + BY2PG;
-		i = i + BY2PG;
-		p->pp_ref ++;
-	}
-	if(sgsize > i) {
-		page_alloc(&p);
-		page_insert(pgdir, p,tempVa, PTE_R);
-		bzero(page2kva(p), sgsize-i);
-		p->pp_ref++;
+	/*Step 2: the rest of the segment, up to `sgsize`, is bss: leave it to
+    * be zero-filled on first touch. */
+	if (tempVa < ROUND(va + sgsize, BY2PG)) {
+		r = env_region_add(env, tempVa,
+						   (ROUND(va + sgsize, BY2PG) - tempVa) / BY2PG, PTE_R);
+		if (r < 0) return r;
 	}
 	if(debug_mode) printf("[DEBUG] have load_elf\n");
 	return 0;
@@ -337,26 +412,11 @@ load_icode(struct Env *e, u_char *binary, u_int size)
 	 *  Remember that the binary image is an a.out format image,
 	 *  which contains both text and data.
      */
-	struct Page *p = NULL;
 	u_long entry_point;
 	u_long r;
-    u_long perm;
     
-    /*Step 1: alloc a page. */
-	r = page_alloc(&p);
-	if(r != 0){
-		if(debug_mode==1) panic("[DEBUG] at load_icode func: page_alloc\n");
-		return ;
-	}
-
-    /*Step 2: Use appropriate perm to set initial stack for new Env. */
-    /*Hint: The user-stack should be writable? */
-	perm = PTE_V | PTE_R;
-	r = page_insert(e->env_pgdir, p, USTACKTOP - BY2PG , perm);
-	if (r != 0) {
-		if(debug_mode == 1)	panic("[DEBUG] at load_icode func: page_insert\n");
-		return;
-	}
+    /*Step 1, 2: nothing to do for the stack: its pages are zero-filled
+     * the first time they are touched (see env_region_lookup). */
 
     /*Step 3:load the binary by using elf loader. */
 	r = load_elf( binary, size, &entry_point, (void *)e, load_icode_mapper);
@@ -413,8 +473,129 @@ env_create(u_char *binary, int size)
 	env_create_priority(binary, size, 1);
 }
 
+/* Overview:
+ *  Register [va, va + npages * BY2PG) as a demand-zero region of `e`,
+ *  mapped with `perm` when touched.
+ *
+ * Post-Condition:
+ *  Return 0 on success, -E_INVAL if the range is bad or overlaps another
+ *  region, -E_NO_MEM if `e` has ENV_NREGION regions already or memory is
+ *  short.
+ */
+int
+env_region_add(struct Env *e, u_long va, u_int npages, u_int perm)
+{
+	struct Vmregion *r;
+	u_long end = va + npages * BY2PG;
+	int n = 0;
+
+	if (npages == 0 || va % BY2PG || va >= UTOP || npages > (UTOP - va) / BY2PG) {
+		return -E_INVAL;
+	}
+	LIST_FOREACH(r, &e->env_regions, vr_link) {
+		if (va < r->vr_end && r->vr_start < end) {
+			return -E_INVAL;
+		}
+		n++;
+	}
+	if (n >= ENV_NREGION || (r = kmem_cache_alloc(&region_cache)) == NULL) {
+		return -E_NO_MEM;
+	}
+
+	r->vr_start = va;
+	r->vr_end = end;
+	r->vr_perm = perm | PTE_V;
+	LIST_INSERT_HEAD(&e->env_regions, r, vr_link);
+	return 0;
+}
+
+/* Overview:
+ *  Drop every region of `e` that overlaps [va, va + npages * BY2PG).
+ *  Pages already faulted in stay mapped.
+ */
+void
+env_region_clear(struct Env *e, u_long va, u_int npages)
+{
+	struct Vmregion *r, *next;
+	u_long end = va + npages * BY2PG;
+
+	for (r = LIST_FIRST(&e->env_regions); r; r = next) {
+		next = LIST_NEXT(r, vr_link);
+		if (va < r->vr_end && r->vr_start < end) {
+			LIST_REMOVE(r, vr_link);
+			kmem_cache_free(&region_cache, r);
+		}
+	}
+}
+
+/* Overview:
+ *  Give `dst` the same regions and stack limit as `src` (for fork).
+ */
+int
+env_region_copy(struct Env *dst, struct Env *src)
+{
+	struct Vmregion *r;
+	int ret;
+
+	dst->env_stack_limit = src->env_stack_limit;
+	LIST_FOREACH(r, &src->env_regions, vr_link) {
+		ret = env_region_add(dst, r->vr_start,
+							 (r->vr_end - r->vr_start) / BY2PG, r->vr_perm);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/* Overview:
+ *  Find out whether `va` is demand-zero memory of `e`: part of its stack
+ *  (within env_stack_limit pages below USTACKTOP) or of a region.
+ *
+ * Post-Condition:
+ *  Return 0 and set *perm to the permission to map it with, or
+ *  -E_INVAL if nothing should ever be at `va`.
+ */
+int
+env_region_lookup(struct Env *e, u_long va, u_int *perm)
+{
+	struct Vmregion *r;
+
+	if (va < USTACKTOP && va >= USTACKTOP - e->env_stack_limit * BY2PG) {
+		*perm = PTE_V | PTE_R;
+		return 0;
+	}
+	LIST_FOREACH(r, &e->env_regions, vr_link) {
+		if (va >= r->vr_start && va < r->vr_end) {
+			*perm = r->vr_perm;
+			return 0;
+		}
+	}
+	return -E_INVAL;
+}
+
+/* Overview:
+ *  Check that `e` may take `npages` more pages of memory.
+ *
+ * Post-Condition:
+ *  Return 0, or -E_NO_MEM if that would take it past env_mem_limit.
+ */
+int
+env_mem_check(struct Env *e, u_int npages)
+{
+	u_int used = e->env_rss + e->env_nswap;
+
+	if (used > e->env_mem_limit || npages > e->env_mem_limit - used) {
+		return -E_NO_MEM;
+	}
+	return 0;
+}
+
 /* Overview:
  *  Frees env e and all memory it uses.
+ *
+ * Pre-Condition:
+ *  e has been taken off the scheduler by env_destroy.
  */
 void
 env_free(struct Env *e)
@@ -423,9 +604,12 @@ env_free(struct Env *e)
 	u_int pdeno, pteno, pa;
 
     /* Hint: Note the environment's demise.*/
-	printf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
+	printf("[%08x] free env %08x (%d tlb misses)\n", curenv ? curenv->env_id : 0,
+		   e->env_id, e->env_tlb_misses);
 
-    /* Hint: Flush all mapped pages in the user portion of the address space */
+    /* Hint: Flush all mapped pages in the user portion of the address space.
+     * Nothing will look at these tables again, so drop the pages straight
+     * from the PTEs and clean the TLB up once, at the end. */
 	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) {
         /* Hint: only look at mapped page tables. */
 		if (!(e->env_pgdir[pdeno] & PTE_V)) {
@@ -435,38 +619,75 @@ env_free(struct Env *e)
 		pa = PTE_ADDR(e->env_pgdir[pdeno]);
 		pt = (Pte *)KADDR(pa);
         /* Hint: Unmap all PTEs in this page table. */
-		for (pteno = 0; pteno <= PTX(~0); pteno++)
+		for (pteno = 0; pteno <= PTX(~0); pteno++) {
 			if (pt[pteno] & PTE_V) {
-				page_remove(e->env_pgdir, (pdeno << PDSHIFT) | (pteno << PGSHIFT));
+				page_decref(pa2page(pt[pteno]));
+				pt[pteno] = 0;
+			} else if (PTE_ISSWAP(pt[pteno])) {
+				swap_free(e->env_pgdir, pt[pteno]);
+				pt[pteno] = 0;
 			}
-        /* Hint: free the page table itself. */
+		}
+        /* Hint: free the page table itself; it is all zeros again. */
 		e->env_pgdir[pdeno] = 0;
-		page_decref(pa2page(pa));
+		kmem_page_put(&kmem_pgtables, pa2page(pa));
 	}
-    /* Hint: free the page directory. */
+	tlb_invalidate_pgdir(e->env_pgdir);
+	e->env_rss = 0;
+	e->env_nswap = 0;
+	page_decref(pa2page(PADDR(e->env_info)));
+	e->env_info = NULL;
+	sysstat_free(e);
+    /* Hint: free the page directory, back in the state pgdir_ctor made it. */
 	pa = e->env_cr3;
 	e->env_pgdir = 0;
 	e->env_cr3 = 0;
-	page_decref(pa2page(pa));
+	pa2page(pa)->pp_env = 0;
+	kmem_page_put(&pgdir_cache, pa2page(pa));
+	env_region_clear(e, 0, UTOP / BY2PG);
     /* Hint: return the environment to the free list. */
-	e->env_status = ENV_FREE;
 	LIST_INSERT_HEAD(&env_free_list, e, env_link);
-	LIST_REMOVE(e, env_sched_link);
 }
 
 /* Overview:
- *  Frees env e, and schedules to run a new env 
+ *  Free up to `n` destroyed envs (see env_destroy).
+ *
+ * Post-Condition:
+ *  Return the number of envs freed.
+ */
+int
+env_reap(u_int n)
+{
+	struct Env *e;
+	int freed = 0;
+
+	for (; n > 0 && (e = LIST_FIRST(&env_zombie_list)) != NULL; n--) {
+		LIST_REMOVE(e, env_link);
+		env_free(e);
+		freed++;
+	}
+	return freed;
+}
+
+/* Overview:
+ *  Destroys env e, and schedules to run a new env
  *  if e is the current env.
+ *  e is gone as far as everybody else can tell (its status is ENV_FREE,
+ *  so a parent waiting on it goes on at once), but tearing down its
+ *  memory is left to env_reap, at a moment when nobody is waiting.
  */
 void
 env_destroy(struct Env *e)
 {
-    /* Hint: free e. */
-	env_free(e);
+    /* Hint: retire e. */
+	LIST_REMOVE(e, env_sched_link);
+	timer_cancel(&e->env_timer);
+	e->env_status = ENV_FREE;
+	LIST_INSERT_HEAD(&env_zombie_list, e, env_link);
 
     /* Hint: schedule to run a new environment. */
 	if (curenv == e) {
-		curenv = NULL;
+		env_clear_curenv();
         /* Hint:Why this? */
 		bcopy((void *)KERNEL_SP - sizeof(struct Trapframe),
 			  (void *)TIMESTACK - sizeof(struct Trapframe),
@@ -476,6 +697,43 @@ env_destroy(struct Env *e)
 	}
 }
 
+/* Overview:
+ *  Leave the CPU with no env: TLB refills from now on are the kernel's.
+ */
+void
+env_clear_curenv(void)
+{
+	curenv = NULL;
+	tlb_miss_count = &tlb_miss_kernel;
+}
+
+/* Overview:
+ *  Make sure `e` holds an ASID of the current generation. ASIDs are handed
+ *  out in order and never reused within a generation; when they run out,
+ *  a new generation starts with an empty TLB, and every env takes a fresh
+ *  ASID the next time it runs. ASID 0 is left to the kernel.
+ */
+void
+env_asid_alloc(struct Env *e)
+{
+	static u_int asid_generation = NASID;
+	static u_int asid_next = 1;
+
+	if ((e->env_asid & ~ASID_MASK) == asid_generation) {
+		return;
+	}
+
+	if (asid_next == NASID) {
+		asid_generation += NASID;
+		if (asid_generation == 0) {
+			asid_generation = NASID;
+		}
+		asid_next = 1;
+		tlb_flush_all();
+	}
+	e->env_asid = asid_generation | asid_next++;
+}
+
 extern void env_pop_tf(struct Trapframe *tf, int id);
 extern void lcontext(u_int contxt);
 
@@ -499,6 +757,8 @@ env_run(struct Env *e)
 	
 	struct Trapframe * old;
 	
+	sched_charge();
+	TRACE(TR_SWITCH, e->env_id, curenv ? curenv->env_id : 0, 0);
 	old = (struct Trapframe *) (TIMESTACK - sizeof(struct Trapframe));
 	if(curenv) {
 		bcopy(old, &(curenv->env_tf), sizeof(struct Trapframe));
@@ -511,13 +771,18 @@ env_run(struct Env *e)
 	//	curenv->env_status = ENV_RUNNABLE;
     /*Step 3: Use lcontext() to switch to its address space. */
 	lcontext((u_long)curenv->env_pgdir);		// load env_pgdir from mCONTEXT(a word save addr of pgdir)
+	tlb_miss_count = &curenv->env_tlb_misses;
+	kclock_update();
+	env_info_update(curenv);
 	// printf("[DEBUG] env_run: curenv pri %d \n", curenv->env_pri);
     /*Step 4: Use env_pop_tf() to restore the environment's
      * environment   registers and drop into user mode in the
      * the   environment.
      */
-    /* Hint: You should use GET_ENV_ASID there.Think why? */
-	env_pop_tf(&(curenv->env_tf), GET_ENV_ASID(curenv->env_id));	
+    /* Hint: the env keeps its ASID across switches, so the TLB entries
+     * it left behind are still good. */
+	env_asid_alloc(curenv);
+	env_pop_tf(&(curenv->env_tf), ENV_ASID(curenv));	
 	
 }
 void env_check()
@@ -4,9 +4,28 @@
 /* The run time clock is hard-wired to IRQ8. */
 
 #include <kclock.h>
+#include <printf.h>
 
 
-extern void set_timer();
+extern void set_timer(u_int hz);
+
+volatile u_int kclock_ticks;		// ticks taken since boot
+static u_int kclock_hz;
+static int kclock_stopped;			// tick suppressed, see kclock_suspend
+
+struct Timepage *timepage;			// set up by mips_vm_init
+static u_int kclock_boot_sec, kclock_boot_usec;	// RTC time at kclock_init
+
+/* Overview:
+ *	Read the RTC, which counts real time in seconds and microseconds.
+ */
+static void
+kclock_rtc(u_int *sec, u_int *usec)
+{
+	*(volatile u_char *)IO_RTC_TRIGGER = 0;
+	*sec = *(volatile u_int *)IO_RTC_SEC;
+	*usec = *(volatile u_int *)IO_RTC_USEC;
+}
 
 void
 kclock_init(void)
@@ -16,9 +35,120 @@ kclock_init(void)
 	//outb(IO_TIMER1, TIMER_DIV(100) % 256);
 	//outb(IO_TIMER1, TIMER_DIV(100) / 256);
 	//printf("	Setup timer interrupts via 8259A\n");
-	set_timer();
+	kclock_hz = HZ;
+	kclock_rtc(&kclock_boot_sec, &kclock_boot_usec);
+	timepage->tp_hz = kclock_hz;
+	kclock_update();
+	set_timer(kclock_hz);
+	printf("kclock: %d Hz\n", kclock_hz);
 	//irq_setmask_8259A (irq_mask_8259A & ~(1<<0));
 	//printf("	unmasked timer interrupt\n");
 	
 }
 
+/* Overview:
+ *	Change the tick rate to `hz` ticks per second (0 for none at all).
+ */
+void
+kclock_set_hz(u_int hz)
+{
+	kclock_hz = hz;
+	timepage->tp_seq++;
+	timepage->tp_hz = hz;
+	timepage->tp_seq++;
+	if (!kclock_stopped) {
+		*(volatile u_char *)IO_RTC = hz;
+	}
+}
+
+/* Overview:
+ *	Account for one clock interrupt and acknowledge it.
+ */
+void
+kclock_tick(void)
+{
+	*(volatile u_char *)IO_RTC_ACK = 0;
+	kclock_ticks++;
+	kclock_update();
+}
+
+/* Overview:
+ *	Read the time since boot.
+ */
+void
+kclock_now(u_int *sec, u_int *usec)
+{
+	static u_int last_sec, last_usec;
+
+	kclock_rtc(sec, usec);
+	if (*usec < kclock_boot_usec) {
+		(*sec)--;
+		*usec += 1000000;
+	}
+	*sec -= kclock_boot_sec;
+	*usec -= kclock_boot_usec;
+
+	// The host clock the RTC reads may be stepped back; ours may not.
+	if (*sec < last_sec || (*sec == last_sec && *usec < last_usec)) {
+		*sec = last_sec;
+		*usec = last_usec;
+	}
+	last_sec = *sec;
+	last_usec = *usec;
+}
+
+/* Overview:
+ *	The time since boot in microseconds, wrapping every 71 minutes: only
+ *	good for measuring intervals shorter than that.
+ */
+u_int
+kclock_us(void)
+{
+	u_int sec, usec;
+
+	kclock_now(&sec, &usec);
+	return sec * 1000000 + usec;
+}
+
+/* Overview:
+ *	Publish the tick count and the time since boot on the time page.
+ */
+void
+kclock_update(void)
+{
+	u_int sec, usec;
+
+	kclock_now(&sec, &usec);
+	timepage->tp_seq++;
+	timepage->tp_ticks = kclock_ticks;
+	timepage->tp_sec = sec;
+	timepage->tp_usec = usec;
+	timepage->tp_seq++;
+}
+
+/* Overview:
+ *	Stop the tick while there is nothing for it to do: only one env wants
+ *	the CPU, so it would only ever be preempted to be run again.
+ *	kclock_resume starts it again.
+ */
+void
+kclock_suspend(void)
+{
+	if (!kclock_stopped) {
+		kclock_stopped = 1;
+		*(volatile u_char *)IO_RTC = 0;
+	}
+}
+
+/* Overview:
+ *	Restart a suspended tick. Called whenever an env may have become
+ *	runnable, so that it gets its share of the CPU.
+ */
+void
+kclock_resume(void)
+{
+	if (kclock_stopped) {
+		kclock_stopped = 0;
+		*(volatile u_char *)IO_RTC = kclock_hz;
+	}
+}
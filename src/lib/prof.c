@@ -0,0 +1,86 @@
+#include <prof.h>
+#include <env.h>
+#include <printf.h>
+#include <pmap.h>
+
+static struct Profrec prof_tab[PROF_NSLOT];
+static u_int prof_dropped;		// samples that found no free slot
+int prof_on;
+
+/* Overview:
+ *	Count a sample of curenv at `pc`. Called by timer_irq (lib/genex.S),
+ *	while profiling is on, before the tick is handled.
+ */
+void
+prof_sample(u_int pc)
+{
+	extern struct Env *curenv;
+	struct Profrec *r;
+	u_int envid, h, i;
+
+	if (curenv == 0) {
+		return;
+	}
+	envid = curenv->env_id;
+	h = (pc >> 2) ^ (envid * 0x9e3779b1);
+	for (i = 0; i < PROF_PROBE; i++) {
+		r = &prof_tab[(h + i) % PROF_NSLOT];
+		if (r->pr_count == 0) {
+			r->pr_envid = envid;
+			r->pr_pc = pc;
+		}
+		if (r->pr_envid == envid && r->pr_pc == pc) {
+			r->pr_count++;
+			return;
+		}
+	}
+	prof_dropped++;
+}
+
+void
+prof_start(void)
+{
+	bzero(prof_tab, sizeof(prof_tab));
+	prof_dropped = 0;
+	prof_on = 1;
+}
+
+u_int
+prof_stop(void)
+{
+	prof_on = 0;
+	return prof_dropped;
+}
+
+/* Overview:
+ *	Copy up to `n` of the counts to the array at `va` in curenv, after
+ *	skipping the first `skip` of them, so that a small buffer can read the
+ *	whole table in turns.
+ *
+ * Post-Condition:
+ *	Return the number of counts copied, 0 once they are all read, or
+ *	the error of copyout if not even the first could be.
+ */
+int
+prof_read(u_int skip, u_long va, u_int n)
+{
+	u_int i, k = 0;
+	int r;
+
+	for (i = 0; i < PROF_NSLOT && k < n; i++) {
+		if (prof_tab[i].pr_count == 0) {
+			continue;
+		}
+		if (skip > 0) {
+			skip--;
+			continue;
+		}
+		r = copyout(va + k * sizeof(struct Profrec), &prof_tab[i],
+					sizeof(struct Profrec));
+		if (r < 0) {
+			return k ? k : r;
+		}
+		k++;
+	}
+	return k;
+}
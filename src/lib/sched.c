@@ -1,42 +1,213 @@
 #include <env.h>
 #include <pmap.h>
 #include <printf.h>
+#include <kclock.h>
+#include <sched.h>
+#include <prof.h>
 extern int debug_mode;
+
+unsigned int sched_vtime;		// pass of the env picked last
+static u_int sched_stamp;		// when curenv was last charged (kclock_us)
+static struct Env *sched_deferred;	// see sched_defer
+
 /* Overview:
- *  Implement simple round-robin scheduling.
- *  Search through 'envs' for a runnable environment ,
- *  in circular fashion statrting after the previously running env,
- *  and switch to the first such environment found.
- *
- * Hints:
- *  The variable which is for counting should be defined as 'static'.
+ *  Return the env whose scheduling context (pass and tickets) `e` runs
+ *  on: the client it is serving, if a request lent it one (see
+ *  sched_lend), else `e` itself.
  */
-void sched_yield(void)
+struct Env *
+sched_ctx(struct Env *e)
 {
-	static int time_counter = 0;
-	static struct Env * cur = NULL;
-	static int index = 0;
-	while(1) {
-		while(LIST_FIRST(&env_sched_list[index])==NULL) {
-			index = 1 - index;
-		}
-		cur = LIST_FIRST(&env_sched_list[index]);
-		// time_counter = cur->env_pri;
-		if(debug_mode) {
-//			printf("[DEBUG] env: %d \n", cur!=NULL);	
-//			printf("[DEBUG] env_pri: %d\n",cur->env_pri);
-//			printf("[DEBUG] env_status:%d\n",cur->env_status == ENV_RUNNABLE);
-	
-		}
-		if(time_counter >= cur->env_pri || cur->env_status != ENV_RUNNABLE) {
-			time_counter = 0;
-			LIST_REMOVE(cur, env_sched_link);
-			LIST_INSERT_HEAD(&env_sched_list[1-index], cur, env_sched_link);
+	struct Env *d;
+
+	if (e->env_donor == 0) {
+		return e;
+	}
+	d = &envs[ENVX(e->env_donor)];
+	if (d->env_id != e->env_donor || d->env_status == ENV_FREE) {
+		e->env_donor = 0;		// the client is gone
+		return e;
+	}
+	return d;
+}
+
+/* Overview:
+ *  `to` has just been sent a message by `from`. Unless this answers a
+ *  request `from` was serving for `to`, `to` now runs on `from`'s
+ *  scheduling context: a client blocked waiting for a server lends it its
+ *  share and pays for the service, so the reply does not wait behind
+ *  unrelated envs. The loan ends when `to` answers, or when it goes back
+ *  to sys_ipc_recv.
+ */
+void
+sched_lend(struct Env *from, struct Env *to)
+{
+	struct Env *ctx = sched_ctx(from);
+
+	if (from->env_donor == to->env_id) {
+		from->env_donor = 0;
+	}
+	if (ctx != to) {
+		to->env_donor = ctx->env_id;
+	}
+}
+
+/* Overview:
+ *  Charge curenv for the CPU time since it was last charged, and start
+ *  counting again from now. Called on every clock tick and every switch.
+ *  The CPU time is curenv's; the pass that advances is that of its
+ *  scheduling context.
+ */
+void
+sched_charge(void)
+{
+	struct Env *ctx;
+
+	u_int now = kclock_us(), used = now - sched_stamp;
+
+	sched_stamp = now;
+	if (curenv == NULL) {
+		return;
+	}
+	curenv->env_cpu_usec += used;
+	if (curenv->env_cpu_usec >= 1000000) {
+		curenv->env_cpu_sec += curenv->env_cpu_usec / 1000000;
+		curenv->env_cpu_usec %= 1000000;
+	}
+	ctx = sched_ctx(curenv);
+	ctx->env_pass += used / SCHED_TICKETS(ctx) + 1;
+}
+
+/* Overview:
+ *  Tell whether an env other than `e` (which may be NULL) is runnable.
+ */
+static int
+sched_runnable_besides(struct Env *e)
+{
+	struct Env *p;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		LIST_FOREACH(p, &env_sched_list[i], env_sched_link) {
+			if (p != e && p->env_status == ENV_RUNNABLE) {
+				return 1;
+			}
 		}
-		else {
-			time_counter++;
-			break;
+	}
+	return 0;
+}
+
+/* Overview:
+ *  Nothing can run. Catch up on deferred work, then wait for the next
+ *  clock interrupt. Interrupts stay disabled: the pending bit is polled,
+ *  so the context saved for curenv is left alone.
+ */
+static void
+sched_idle(void)
+{
+	// curenv is blocked: put its context away now, so that whatever wakes
+	// it up (a timer) can set its return value in env_tf.
+	if (curenv) {
+		sched_charge();
+		bcopy((void *)(TIMESTACK - sizeof(struct Trapframe)),
+			  &curenv->env_tf, sizeof(struct Trapframe));
+		curenv->env_tf.pc = curenv->env_tf.cp0_epc;
+		env_clear_curenv();
+	}
+
+	kclock_resume();
+	env_reap(1);
+	page_zero_refill(PAGE_ZERO_BATCH);
+	while (!kclock_pending()) {
+		;
+	}
+	kclock_tick();
+	timer_run();
+}
+
+/* Overview:
+ *  Clock interrupt. Fire the timers that are due. If curenv is the only
+ *  env that wants the CPU and no timer is pending, keep running it and
+ *  stop the tick until another env is woken up; otherwise pick the next
+ *  env to run.
+ */
+void
+sched_tick(void)
+{
+	kclock_tick();
+	timer_run();
+	sched_charge();
+	if (curenv) {
+		env_info_update(curenv);
+	}
+	if (curenv && curenv->env_status == ENV_RUNNABLE && !prof_on &&
+		timer_npending == 0 && !sched_runnable_besides(curenv)) {
+		kclock_suspend();
+		return;
+	}
+	sched_yield();
+}
+
+/* Overview:
+ *  Let every other runnable env go before `e` at the next pick, whatever
+ *  the passes say: `e` gave the CPU up (sys_yield), most likely to wait
+ *  for one of them.
+ */
+void
+sched_defer(struct Env *e)
+{
+	sched_deferred = e;
+}
+
+/* Overview:
+ *  Pick the runnable env with the lowest pass, or NULL if there is none.
+ *  An env that has been blocked for a while is first brought up to within
+ *  SCHED_MAX_LAG of sched_vtime.
+ */
+static struct Env *
+sched_pick(void)
+{
+	struct Env *e, *ctx, *best = NULL, *deferred = sched_deferred;
+	u_int pass = 0;
+	int i;
+
+	sched_deferred = NULL;
+	for (i = 0; i < 2; i++) {
+		LIST_FOREACH(e, &env_sched_list[i], env_sched_link) {
+			if (e->env_status != ENV_RUNNABLE || e == deferred) {
+				continue;
+			}
+			ctx = sched_ctx(e);
+			if ((int)(ctx->env_pass - sched_vtime) < -SCHED_MAX_LAG) {
+				ctx->env_pass = sched_vtime - SCHED_MAX_LAG;
+			}
+			if (best == NULL || (int)(ctx->env_pass - pass) < 0) {
+				best = e;
+				pass = ctx->env_pass;
+			}
 		}
 	}
-	env_run(cur);
+
+	if (best == NULL && deferred && deferred->env_status == ENV_RUNNABLE) {
+		return deferred;
+	}
+	if (best && (int)(pass - sched_vtime) > 0) {
+		sched_vtime = pass;
+	}
+	return best;
+}
+
+/* Overview:
+ *  Stride scheduling (see sched.h): switch to the runnable env with the
+ *  lowest pass, idling until there is one.
+ */
+void sched_yield(void)
+{
+	struct Env *e;
+
+	sched_charge();
+	while ((e = sched_pick()) == NULL) {
+		sched_idle();
+	}
+	env_run(e);
 }
@@ -4,10 +4,16 @@
 #include <printf.h>
 #include <pmap.h>
 #include <sched.h>
+#include <kclock.h>
+#include <unistd.h>
+#include <trace.h>
+#include <prof.h>
+#include <sysstat.h>
 
 extern char *KERNEL_SP;
 extern struct Env *curenv;
 extern int debug_mode;
+extern int (*sys_call_table[])(int, int, int, int, int, int);
 
 /* Overview:
  * 	This function is used to print a character on screen.
@@ -64,6 +70,7 @@ u_int sys_getenvid(void)
  */
 void sys_yield(void)
 {
+	sched_defer(curenv);
 	bcopy((void*)(KERNEL_SP - sizeof(struct Trapframe)),
 			(void*)(TIMESTACK - sizeof(struct Trapframe)),
 			sizeof(struct Trapframe));
@@ -129,6 +136,33 @@ int sys_set_pgfault_handler(int sysno, u_int envid, u_int func, u_int xstacktop)
 	//	panic("sys_set_pgfault_handler not implemented");
 }
 
+/* Overview:
+ * 	Turn in-kernel copy-on-write resolution on or off for envid.
+ *
+ * Pre-Condition:
+ * 	envid must be the caller itself or one of its children.
+ *
+ * Post-Condition:
+ * 	When enabled, write faults on PTE_COW pages are fixed up by the
+ * 	kernel (see page_cow) instead of being bounced to the user-level
+ * 	page fault handler. Children created by sys_env_alloc inherit it.
+ * 	Returns 0 on success, < 0 on error.
+ */
+int sys_set_kernel_cow(int sysno, u_int envid, u_int enable)
+{
+	struct Env *env;
+	int ret;
+
+	ret = envid2env(envid, &env, 1);
+	if(ret < 0) {
+		if(debug_mode) printf("[DEBUG] sys_set_kernel_cow: Wrong at envid2env\n");
+		return ret;
+	}
+
+	env->env_kcow = (enable != 0);
+	return 0;
+}
+
 /* Overview:
  * 	Allocate a page of memory and map it at 'va' with permission
  * 'perm' in the address space of 'envid'.
@@ -171,13 +205,18 @@ int sys_mem_alloc(int sysno, u_int envid, u_int va, u_int perm)
 		return ret;
 	}
 	Pde * pgdir = env->env_pgdir;
+	ret = env_mem_check(env, 1);
+	if(ret < 0) {
+		if(debug_mode) printf("[DEBUG] sys_mem_alloc: env %08x is at its memory limit\n", env->env_id);
+		return ret;
+	}
 	ret = page_alloc(&ppage);
 	if(ret < 0) {
 		if(debug_mode) panic("[DEBUG] sys_mem_alloc: page_alloc has wrong here\n");
 		return ret;
 	}
 	//ppage -> pp_ref ++;
-	ret = page_insert(pgdir, ppage, va, perm);
+	ret = page_insert(pgdir, ppage, va, perm & PTE_USER);
 	if(ret < 0) {
 		if(debug_mode) panic("[DEBUG] sys_mem_alloc: page_insert has wrong here\n");
 		return ret;
@@ -243,7 +282,8 @@ int sys_mem_map(int sysno, u_int srcid, u_int srcva, u_int dstid, u_int dstva,
 			return -E_INVAL;
 		}
 	} 
-	ret = page_insert(dstenv->env_pgdir, ppage, round_dstva, perm);
+	ret = page_insert(dstenv->env_pgdir, ppage, round_dstva,
+					  perm & (PTE_USER | PTE_COW));
 	if(ret < 0) {
 		if(debug_mode) panic("[DBEUG] sys_mem_map: page_insert error here\n");
 		return ret;
@@ -286,6 +326,109 @@ int sys_mem_unmap(int sysno, u_int envid, u_int va)
 	//	panic("sys_mem_unmap not implemented");
 }
 
+/* Overview:
+ * 	Check that the page range [va, va + npages * BY2PG) lies below UTOP.
+ */
+static int range_check(u_int va, u_int npages)
+{
+	if (npages > UTOP / BY2PG || va >= UTOP || va + npages * BY2PG > UTOP) {
+		return -E_INVAL;
+	}
+	return 0;
+}
+
+/* Overview:
+ * 	Range version of sys_mem_alloc: allocate `npages` pages and map them
+ * at 'va' with permission 'perm' in the address space of 'envid'.
+ * 	The page tables are walked once and the TLB is swept once at the end.
+ *
+ * Pre-Condition:
+ * 	Same restrictions on 'perm' and 'envid' as sys_mem_alloc.
+ *
+ * Post-Condition:
+ * 	Return the number of pages mapped on success, < 0 on error.
+ */
+int sys_mem_alloc_range(int sysno, u_int envid, u_int va, u_int npages,
+						u_int perm)
+{
+	struct Env *env;
+	int ret;
+
+	va = ROUNDDOWN(va, BY2PG);
+	if (range_check(va, npages) < 0 || (perm & PTE_V) == 0 ||
+		(perm & PTE_COW) != 0) {
+		if(debug_mode) printf("[DEBUG] sys_mem_alloc_range: invalid argument\n");
+		return -E_INVAL;
+	}
+	ret = envid2env(envid, &env, 1);
+	if(ret < 0) {
+		return ret;
+	}
+	ret = env_mem_check(env, npages);
+	if(ret < 0) {
+		return ret;
+	}
+
+	return page_alloc_range(env->env_pgdir, va, npages, perm & PTE_USER);
+}
+
+/* Overview:
+ * 	Range version of sys_mem_map: map the `npages` pages at 'srcva' in
+ * the caller's address space at 'dstva' in dstid's address space with
+ * permission 'perm'. Holes in the source range are skipped.
+ * 	(The source is always the caller, since a syscall carries at most
+ * five arguments.)
+ *
+ * Post-Condition:
+ * 	Return the number of pages mapped on success, < 0 on error.
+ */
+int sys_mem_map_range(int sysno, u_int srcva, u_int dstid, u_int dstva,
+					  u_int npages, u_int perm)
+{
+	struct Env *dstenv;
+	int ret;
+
+	srcva = ROUNDDOWN(srcva, BY2PG);
+	dstva = ROUNDDOWN(dstva, BY2PG);
+	if (range_check(srcva, npages) < 0 || range_check(dstva, npages) < 0 ||
+		(perm & PTE_V) == 0) {
+		if(debug_mode) printf("[DEBUG] sys_mem_map_range: invalid argument\n");
+		return -E_INVAL;
+	}
+	ret = envid2env(dstid, &dstenv, 0);
+	if(ret < 0) {
+		return -E_BAD_ENV;
+	}
+
+	return page_map_range(curenv->env_pgdir, srcva, dstenv->env_pgdir, dstva,
+						  npages, perm & (PTE_USER | PTE_COW));
+}
+
+/* Overview:
+ * 	Range version of sys_mem_unmap: unmap the `npages` pages at 'va' in
+ * the address space of 'envid'. Pages that are not mapped are skipped.
+ *
+ * Post-Condition:
+ * 	Return the number of pages unmapped on success, < 0 on error.
+ */
+int sys_mem_unmap_range(int sysno, u_int envid, u_int va, u_int npages)
+{
+	struct Env *env;
+	int ret;
+
+	va = ROUNDDOWN(va, BY2PG);
+	if (range_check(va, npages) < 0) {
+		if(debug_mode) printf("[DEBUG] sys_mem_unmap_range: invalid argument\n");
+		return -E_INVAL;
+	}
+	ret = envid2env(envid, &env, 1);
+	if(ret < 0) {
+		return ret;
+	}
+
+	return page_remove_range(env->env_pgdir, va, npages);
+}
+
 /* Overview:
  * 	Allocate a new environment.
  *
@@ -317,6 +460,12 @@ int sys_env_alloc(void)
 	e->env_tf.regs[2] = 0;
 
 	e->env_pri = curenv->env_pri;
+	e->env_kcow = curenv->env_kcow;
+	e->env_mem_limit = curenv->env_mem_limit;
+	if ((r = env_region_copy(e, curenv)) < 0) {
+		env_destroy(e);
+		return r;
+	}
 	return e->env_id;
 	//	panic("sys_env_alloc not implemented");
 }
@@ -349,6 +498,15 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
 	}
 	
 	env->env_status = status;				//  是否需要将它装入可以调度的队列呢？在这里env本身就在可以调度的队列里面。
+	// Whatever the env was waiting for with a timeout is over: a stale
+	// timer would otherwise fail some later wait of it.
+	timer_cancel(&env->env_timer);
+	if (status == ENV_RUNNABLE) {
+		TRACE(TR_WAKE, env->env_id, curenv->env_id, 0);
+		kclock_resume();
+	} else if (status == ENV_NOT_RUNNABLE) {
+		TRACE(TR_BLOCK, env->env_id, TRB_STATUS, curenv->env_id);
+	}
 
 	return 0;
 	//	panic("sys_env_set_status not implemented");
@@ -387,6 +545,40 @@ void sys_panic(int sysno, char *msg)
 	panic("%s", TRUP(msg));
 }
 
+/* Overview:
+ * 	Timer callback of an env blocked in sys_sleep or sys_ipc_recv: make
+ * it runnable again, the receive failing with -E_TIMEOUT.
+ */
+static void env_timeout(struct Timer *t)
+{
+	struct Env *e = timer2env(t);
+
+	if (e->env_ipc_recving) {
+		e->env_ipc_recving = 0;
+		e->env_tf.regs[2] = -E_TIMEOUT;
+	} else {
+		e->env_tf.regs[2] = 0;
+	}
+	e->env_status = ENV_RUNNABLE;
+	TRACE(TR_WAKE, e->env_id, 0, 0);
+}
+
+/* Overview:
+ * 	Give up the CPU for at least 'ms' milliseconds (rounded up to clock
+ * ticks); nothing runs in the meantime on the caller's behalf.
+ *
+ * Post-Condition:
+ * 	Return 0 once the time is up.
+ */
+int sys_sleep(int sysno, u_int ms)
+{
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	TRACE(TR_BLOCK, curenv->env_id, TRB_SLEEP, ms);
+	timer_set(&curenv->env_timer, timer_ms2ticks(ms), env_timeout);
+	sys_yield();
+	return 0;
+}
+
 /* Overview:
  * 	This function enables caller to receive message from 
  * other process. To be more specific, it will flag 
@@ -399,17 +591,28 @@ void sys_panic(int sysno, char *msg)
  * Post-Condition:
  * 	This syscall will set the current process's status to 
  * ENV_NOT_RUNNABLE, giving up cpu. 
+ * 	With 'ms' other than 0, give up after that many milliseconds: the
+ * syscall then returns -E_TIMEOUT instead of 0.
  */
-void sys_ipc_recv(int sysno, u_int dstva)
+int sys_ipc_recv(int sysno, u_int dstva, u_int ms)
 {
 	if (dstva >= UTOP) {
 		if(debug_mode) panic("[DEBUG] sys_ipc_recv: wrong dstva!\n");
+		return -E_INVAL;
 	}
 	curenv->env_status = ENV_NOT_RUNNABLE;
 	curenv->env_ipc_dstva = dstva;
 	curenv->env_ipc_recving = 1;
+	curenv->env_donor = 0;			// done with whatever we were serving
+	TRACE(TR_IPC_RECV, curenv->env_id, dstva, ms);
+	if (ms) {
+		timer_set(&curenv->env_timer, timer_ms2ticks(ms), env_timeout);
+	} else {
+		timer_cancel(&curenv->env_timer);
+	}
 	// sched_yield();
 	sys_yield();
+	return 0;
 }
 
 /* Overview:
@@ -468,7 +671,12 @@ int sys_ipc_can_send(int sysno, u_int envid, u_int value, u_int srcva,
 		}
 	}
 	e->env_ipc_perm = perm;
+	timer_cancel(&e->env_timer);
+	e->env_tf.regs[2] = 0;			// what its sys_ipc_recv returns
+	sched_lend(curenv, e);
+	TRACE(TR_IPC_SEND, curenv->env_id, e->env_id, value);
 	e->env_status = ENV_RUNNABLE; 
+	kclock_resume();
 	return 0;
 }
 
@@ -509,8 +717,18 @@ int sys_write_dev(int sysno, u_int va, u_int dev, u_int len)
 		return -E_INVAL;
 	}
 
-	int dev_kva = dev + 0xA0000000;
-	bcopy(va, dev_kva, len);
+	// Through a bounce buffer, so that a bad 'va' fails the call instead
+	// of faulting in the kernel.
+	u_int buf[32], n;
+	int r;
+	u_int dev_kva = dev + 0xA0000000;
+	for (; len > 0; va += n, dev_kva += n, len -= n) {
+		n = MIN(len, sizeof(buf));
+		if ((r = copyin(buf, va, n)) < 0) {
+			return r;
+		}
+		bcopy(buf, (void *)dev_kva, n);
+	}
 	return 0;
 }
 
@@ -541,8 +759,285 @@ int sys_read_dev(int sysno, u_int va, u_int dev, u_int len)
 		if(debug_mode) panic("[DEBUG] sys_write_dev: va is error!\n");
 		return -E_INVAL;
 	}
+	u_int buf[32], n;
+	int r;
 	u_int dev_va = dev + 0xA0000000;
 
-	bcopy(dev_va, va, len);
+	for (; len > 0; va += n, dev_va += n, len -= n) {
+		n = MIN(len, sizeof(buf));
+		bcopy((void *)dev_va, buf, n);
+		if ((r = copyout(va, buf, n)) < 0) {
+			return r;
+		}
+	}
 	return 0;
 }
+
+/* Overview:
+ * 	Tell whether syscall `sysno` may run inside a batch. Syscalls that
+ * can give up the CPU (or never return) must be issued on their own.
+ */
+static int sys_batchable(u_int sysno)
+{
+	if (sysno < __SYSCALL_BASE || sysno >= __SYSCALL_BASE + __NR_SYSCALLS) {
+		return 0;
+	}
+
+	switch (sysno) {
+	case SYS_yield:
+	case SYS_env_destroy:
+	case SYS_env_alloc:
+	case SYS_ipc_recv:
+	case SYS_batch:
+	case SYS_sleep:
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Overview:
+ * 	Run the `n` syscall records at 'va' in order within this single
+ * kernel entry, storing every result in the record's sb_ret.
+ *
+ * Pre-Condition:
+ * 	Records must not name a syscall that may switch environments (see
+ * sys_batchable).
+ *
+ * Post-Condition:
+ * 	Stops at the first record whose result is < 0, or that cannot be
+ * read or written back.
+ * 	Returns the number of records that succeeded, or the error of
+ * copyin/copyout if the first record cannot be.
+ */
+int sys_batch(int sysno, u_int va, u_int n)
+{
+	struct Sysbatch b;
+	u_int i;
+	int r;
+
+	for (i = 0; i < n; i++, va += sizeof(b)) {
+		if ((r = copyin(&b, va, sizeof(b))) < 0) {
+			if(debug_mode) printf("[DEBUG] sys_batch: bad record array\n");
+			return i ? i : r;
+		}
+		if (!sys_batchable(b.sb_sysno)) {
+			b.sb_ret = -E_INVAL;
+		} else {
+			b.sb_ret = sys_call_table[b.sb_sysno - __SYSCALL_BASE](
+							b.sb_sysno - __SYSCALL_BASE, b.sb_args[0],
+							b.sb_args[1], b.sb_args[2], b.sb_args[3],
+							b.sb_args[4]);
+		}
+		if ((r = copyout(va + offsetof(struct Sysbatch, sb_ret), &b.sb_ret,
+						 sizeof(b.sb_ret))) < 0) {
+			return i ? i : r;
+		}
+		if (b.sb_ret < 0) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/* Overview:
+ * 	Register [va, va + npages * BY2PG) as demand-zero memory of 'envid':
+ * a page there that is touched before anything is mapped gets a fresh
+ * zeroed page with permission 'perm'. With 'perm' 0, drop instead every
+ * region that overlaps the range.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, < 0 on error.
+ */
+int sys_mem_region(int sysno, u_int envid, u_int va, u_int npages, u_int perm)
+{
+	struct Env *env;
+	int ret;
+
+	if (range_check(va, npages) < 0 || va % BY2PG || (perm & PTE_COW) != 0) {
+		if(debug_mode) printf("[DEBUG] sys_mem_region: invalid argument\n");
+		return -E_INVAL;
+	}
+	ret = envid2env(envid, &env, 1);
+	if(ret < 0) {
+		return ret;
+	}
+
+	if (perm == 0) {
+		env_region_clear(env, va, npages);
+		return 0;
+	}
+	return env_region_add(env, va, npages, perm & PTE_USER);
+}
+
+/* Overview:
+ * 	Let the stack of 'envid' grow to 'npages' pages below USTACKTOP.
+ * Touching the stack beyond that kills the env.
+ */
+int sys_set_stack_limit(int sysno, u_int envid, u_int npages)
+{
+	struct Env *env;
+	int ret;
+
+	if (npages > (USTACKTOP - UTEXT) / BY2PG) {
+		return -E_INVAL;
+	}
+	ret = envid2env(envid, &env, 1);
+	if(ret < 0) {
+		return ret;
+	}
+
+	env->env_stack_limit = npages;
+	return 0;
+}
+
+/* Overview:
+ * 	Cap the memory of 'envid' (resident plus swapped out pages) at
+ * 'npages'; ENV_MEM_UNLIMITED lifts the cap. Limits nest: nobody gets a
+ * higher limit than the caller's own.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, < 0 on error. Pages already held above the new
+ * limit stay; only new ones are refused.
+ */
+int sys_set_mem_limit(int sysno, u_int envid, u_int npages)
+{
+	struct Env *env;
+	int ret;
+
+	if (npages > curenv->env_mem_limit) {
+		if(debug_mode) printf("[DEBUG] sys_set_mem_limit: above the caller's own limit\n");
+		return -E_INVAL;
+	}
+	ret = envid2env(envid, &env, 1);
+	if(ret < 0) {
+		return ret;
+	}
+
+	env->env_mem_limit = npages;
+	return 0;
+}
+
+/* Overview:
+ * 	Report the memory use of any env 'envid' in the Memstat at 'va'.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, < 0 on error.
+ */
+int sys_mem_stat(int sysno, u_int envid, u_int va)
+{
+	struct Env *env;
+	struct Memstat ms;
+	int ret;
+
+	ret = envid2env(envid, &env, 0);
+	if(ret < 0) {
+		return ret;
+	}
+
+	ms.ms_rss = env->env_rss;
+	ms.ms_nswap = env->env_nswap;
+	ms.ms_limit = env->env_mem_limit;
+	return copyout(va, &ms, sizeof(ms));
+}
+
+/* Overview:
+ * 	Report the CPU use of any env 'envid' in the Cpustat at 'va'.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, < 0 on error.
+ */
+int sys_cpu_stat(int sysno, u_int envid, u_int va)
+{
+	struct Env *env;
+	struct Cpustat cs;
+	int ret;
+
+	ret = envid2env(envid, &env, 0);
+	if(ret < 0) {
+		return ret;
+	}
+
+	// Bring the caller's own count up to date.
+	sched_charge();
+	cs.cs_sec = env->env_cpu_sec;
+	cs.cs_usec = env->env_cpu_usec;
+	cs.cs_runs = env->env_runs;
+	cs.cs_tickets = SCHED_TICKETS(env);
+	return copyout(va, &cs, sizeof(cs));
+}
+
+/* Overview:
+ * 	Control the kernel event trace (see include/trace.h): TRACE_START
+ * empties it and starts recording, TRACE_STOP stops, TRACE_READ moves up
+ * to 'n' of the oldest unread records to the array at 'va', and
+ * TRACE_LOST tells how many were overwritten before anyone read them.
+ *
+ * Post-Condition:
+ * 	TRACE_READ returns the number of records copied, TRACE_LOST the
+ * count; the others return 0. -E_INVAL for a bad op or array.
+ */
+int sys_trace_ctl(int sysno, u_int op, u_int va, u_int n)
+{
+	switch (op) {
+	case TRACE_START:
+		trace_start();
+		return 0;
+	case TRACE_STOP:
+		trace_on = 0;
+		return 0;
+	case TRACE_READ:
+		return trace_read(va, n);
+	case TRACE_LOST:
+		return trace_lost();
+	}
+	return -E_INVAL;
+}
+
+/* Overview:
+ * 	Control the sampling profiler (see include/prof.h): PROF_START clears
+ * the counts and starts sampling, PROF_STOP stops, PROF_READ copies up to
+ * 'n' counts to the array at 'va', skipping the first 'arg' of them.
+ *
+ * Post-Condition:
+ * 	PROF_STOP returns the number of samples dropped for want of room,
+ * PROF_READ the number of counts copied, PROF_START 0. -E_INVAL for a bad
+ * op or array.
+ */
+int sys_prof_ctl(int sysno, u_int op, u_int arg, u_int va, u_int n)
+{
+	switch (op) {
+	case PROF_START:
+		prof_start();
+		kclock_resume();			// sample even a lone env
+		return 0;
+	case PROF_STOP:
+		return prof_stop();
+	case PROF_READ:
+		return prof_read(arg, va, n);
+	}
+	return -E_INVAL;
+}
+
+/* Overview:
+ * 	Copy the syscall counts of 'envid' (SYSSTAT_ALL: of every env since
+ * boot) to the array at 'va': one struct Sysstat per syscall number, up
+ * to 'n' of them.
+ *
+ * Post-Condition:
+ * 	Return the number of records filled in, or an error.
+ */
+int sys_sys_stat(int sysno, u_int envid, u_int va, u_int n)
+{
+	struct Env *env = 0;
+	int ret;
+
+	if (envid != SYSSTAT_ALL) {
+		ret = envid2env(envid, &env, 0);
+		if(ret < 0) {
+			return ret;
+		}
+	}
+	return sysstat_read(env, va, n);
+}
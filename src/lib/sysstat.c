@@ -0,0 +1,114 @@
+#include <sysstat.h>
+#include <env.h>
+#include <kmem.h>
+#include <kclock.h>
+#include <trace.h>
+#include <printf.h>
+#include <pmap.h>
+
+static struct Sysstat sysstat_all[__NR_SYSCALLS];	// every env, since boot
+static struct Kmem_cache sysstat_cache;				// per-env tables
+
+void
+sysstat_init(void)
+{
+	kmem_cache_init(&sysstat_cache, "sysstat", sizeof(sysstat_all), 0);
+}
+
+/* Overview:
+ *	Count a call of syscall `n` (relative to __SYSCALL_BASE) by curenv and
+ *	note when it began. An env gets its table on its first syscall; if
+ *	there is no memory for it, only the system table counts the call.
+ */
+void
+sysstat_enter(u_int n)
+{
+	extern struct Env *curenv;
+
+	if (n >= __NR_SYSCALLS || curenv == 0) {
+		return;
+	}
+	sysstat_all[n].ss_count++;
+	if (curenv->env_sysstat == 0 &&
+		(curenv->env_sysstat = kmem_cache_alloc(&sysstat_cache)) != 0) {
+		bzero(curenv->env_sysstat, sizeof(sysstat_all));
+	}
+	if (curenv->env_sysstat) {
+		curenv->env_sysstat[n].ss_count++;
+	}
+	curenv->env_sys_stamp = kclock_us();
+}
+
+static void
+sysstat_add(struct Sysstat *s, u_int us)
+{
+	u_int i, lim = 1;
+
+	s->ss_usec += us;
+	for (i = 0; i < SYSSTAT_NBUCKET - 1 && us >= lim; i++) {
+		lim <<= 2;
+	}
+	s->ss_hist[i]++;
+}
+
+/* Overview:
+ *	Called by handle_sys once syscall `sysno` has returned `ret`: time it
+ *	and pass it on to the event trace. Calls that switch envs (sys_yield,
+ *	a blocking sys_ipc_recv, ...) do not come back here; they are counted
+ *	but not timed.
+ */
+void
+sysstat_exit(u_int sysno, int ret)
+{
+	extern struct Env *curenv;
+	u_int n = sysno - __SYSCALL_BASE, us;
+
+	if (n >= __NR_SYSCALLS || curenv == 0) {
+		return;
+	}
+	us = kclock_us() - curenv->env_sys_stamp;
+	sysstat_add(&sysstat_all[n], us);
+	if (curenv->env_sysstat) {
+		sysstat_add(&curenv->env_sysstat[n], us);
+	}
+	if (trace_on) {
+		trace_syscall(sysno, ret);
+	}
+}
+
+void
+sysstat_free(struct Env *e)
+{
+	if (e->env_sysstat) {
+		kmem_cache_free(&sysstat_cache, e->env_sysstat);
+		e->env_sysstat = 0;
+	}
+}
+
+/* Overview:
+ *	Copy the counts of the first `n` syscall numbers to the array at `va`
+ *	in curenv: those of `e`, or of the whole system if `e` is 0.
+ *
+ * Post-Condition:
+ *	Return the number of records filled in, or the error of copyout.
+ */
+int
+sysstat_read(struct Env *e, u_long va, u_int n)
+{
+	static struct Sysstat none[__NR_SYSCALLS];	// an env yet to make a call
+	struct Sysstat *s = none;
+	int r;
+
+	if (n > __NR_SYSCALLS) {
+		n = __NR_SYSCALLS;
+	}
+	if (e == 0) {
+		s = sysstat_all;
+	} else if (e->env_sysstat) {
+		s = e->env_sysstat;
+	}
+	if ((r = copyout(va, s, n * sizeof(struct Sysstat))) < 0) {
+		return r;
+	}
+	return n;
+}
@@ -0,0 +1,66 @@
+#include <timer.h>
+#include <kclock.h>
+#include <printf.h>
+
+static struct Timer_list timer_wheel[TIMER_NSLOT];
+u_int timer_npending;		// armed timers; the tick must keep running
+
+/* Overview:
+ *	Arm `t` to call `fn` in `ticks` clock ticks (at least one), replacing
+ *	whatever it was set to before.
+ */
+void
+timer_set(struct Timer *t, u_int ticks, void (*fn)(struct Timer *t))
+{
+	timer_cancel(t);
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	t->t_expires = kclock_ticks + ticks;
+	t->t_fn = fn;
+	t->t_armed = 1;
+	LIST_INSERT_HEAD(&timer_wheel[t->t_expires % TIMER_NSLOT], t, t_link);
+	timer_npending++;
+	kclock_resume();
+}
+
+/* Overview:
+ *	Disarm `t`, if it is armed.
+ */
+void
+timer_cancel(struct Timer *t)
+{
+	if (t->t_armed) {
+		LIST_REMOVE(t, t_link);
+		t->t_armed = 0;
+		timer_npending--;
+	}
+}
+
+/* Overview:
+ *	Fire the timers due at the current tick. Called once per clock tick,
+ *	after kclock_tick.
+ */
+void
+timer_run(void)
+{
+	struct Timer *t, *next;
+	struct Timer_list *slot = &timer_wheel[kclock_ticks % TIMER_NSLOT];
+
+	for (t = LIST_FIRST(slot); t; t = next) {
+		next = LIST_NEXT(t, t_link);
+		if ((int)(kclock_ticks - t->t_expires) >= 0) {
+			timer_cancel(t);
+			t->t_fn(t);
+		}
+	}
+}
+
+/* Overview:
+ *	Convert `ms` milliseconds to clock ticks, rounding up.
+ */
+u_int
+timer_ms2ticks(u_int ms)
+{
+	return (ms / 1000) * HZ + ((ms % 1000) * HZ + 999) / 1000;
+}
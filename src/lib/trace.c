@@ -0,0 +1,85 @@
+#include <trace.h>
+#include <kclock.h>
+#include <env.h>
+#include <unistd.h>
+#include <printf.h>
+#include <pmap.h>
+
+static struct Tracerec trace_ring[TRACE_NREC];
+static u_int trace_head;		// records ever written since trace_start
+static u_int trace_tail;		// of which read out or lost
+static u_int trace_nlost;
+int trace_on;
+
+/* Overview:
+ *	Append one record to the ring, overwriting the oldest one if it is
+ *	full. Callers go through TRACE(), which skips this when tracing is off.
+ */
+void
+trace_log(u_int type, u_int envid, u_int arg0, u_int arg1)
+{
+	struct Tracerec *r = &trace_ring[trace_head % TRACE_NREC];
+
+	r->tr_usec = kclock_us();
+	r->tr_type = type;
+	r->tr_envid = envid;
+	r->tr_arg[0] = arg0;
+	r->tr_arg[1] = arg1;
+	trace_head++;
+	if (trace_head - trace_tail > TRACE_NREC) {
+		trace_tail++;
+		trace_nlost++;
+	}
+}
+
+/* Overview:
+ *	Called by sysstat_exit after a syscall returned, while tracing is on.
+ *	Syscalls that switch envs do not come back there.
+ */
+void
+trace_syscall(u_int sysno, int ret)
+{
+	extern struct Env *curenv;
+
+	trace_log(TR_SYSCALL, curenv ? curenv->env_id : 0,
+			  sysno - __SYSCALL_BASE, ret);
+}
+
+void
+trace_start(void)
+{
+	trace_head = 0;
+	trace_tail = 0;
+	trace_nlost = 0;
+	trace_on = 1;
+}
+
+/* Overview:
+ *	Move up to `n` of the oldest unread records to the array at `va` in
+ *	curenv. A record that cannot be copied stays unread.
+ *
+ * Post-Condition:
+ *	Return the number of records copied, or the error of copyout if not
+ *	even the first could be.
+ */
+int
+trace_read(u_long va, u_int n)
+{
+	u_int i;
+	int r;
+
+	for (i = 0; i < n && trace_tail != trace_head; i++, trace_tail++) {
+		r = copyout(va + i * sizeof(struct Tracerec),
+					&trace_ring[trace_tail % TRACE_NREC], sizeof(struct Tracerec));
+		if (r < 0) {
+			return i ? i : r;
+		}
+	}
+	return i;
+}
+
+u_int
+trace_lost(void)
+{
+	return trace_nlost;
+}
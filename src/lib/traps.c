@@ -1,6 +1,8 @@
 #include <trap.h>
 #include <env.h>
 #include <printf.h>
+#include <pmap.h>
+#include <trace.h>
 
 extern void handle_int();
 extern void handle_reserved();
@@ -52,16 +54,29 @@ page_fault_handler(struct Trapframe *tf)
     struct Trapframe PgTrapFrame;
     extern struct Env *curenv;
 
+    // Fast path: fix the COW page here and simply retry the faulting store.
+    if (curenv->env_kcow && page_cow(curenv->env_pgdir, tf->cp0_badvaddr) == 0) {
+        TRACE(TR_FAULT, curenv->env_id, tf->cp0_badvaddr, TRF_COW);
+        return;
+    }
+    TRACE(TR_FAULT, curenv->env_id, tf->cp0_badvaddr, TRF_USER);
+
     bcopy(tf, &PgTrapFrame, sizeof(struct Trapframe));
 
+    // The exception stack is the env's memory: an env that never mapped
+    // it (or set a bogus one) dies rather than faulting in the kernel.
     if (tf->regs[29] >= (curenv->env_xstacktop - BY2PG) &&
         tf->regs[29] <= (curenv->env_xstacktop - 1)) {
             tf->regs[29] = tf->regs[29] - sizeof(struct  Trapframe);
-            bcopy(&PgTrapFrame, (void *)tf->regs[29], sizeof(struct Trapframe));
         } else {
             tf->regs[29] = curenv->env_xstacktop - sizeof(struct  Trapframe);
-            bcopy(&PgTrapFrame,(void *)curenv->env_xstacktop - sizeof(struct  Trapframe),sizeof(struct Trapframe));
         }
+    if (copyout(tf->regs[29], &PgTrapFrame, sizeof(struct Trapframe)) < 0) {
+        printf("[%08x] fault at va %x pc %x: no exception stack at %x\n",
+               curenv->env_id, tf->cp0_badvaddr, tf->cp0_epc, tf->regs[29]);
+        env_destroy(curenv);
+        return;
+    }
     // TODO: Set EPC to a proper value in the trapframe
 	tf->cp0_epc = curenv->env_pgfault_handler;
     return;
@@ -0,0 +1,177 @@
+#include "mmu.h"
+#include "pmap.h"
+#include "kmem.h"
+#include "printf.h"
+#include "error.h"
+
+// Page tables come back from env_free with every entry cleared.
+struct Kmem_pgcache kmem_pgtables;
+
+static struct Kmem_pgcache *kmem_pgcaches;	// every page cache, for kmem_reap
+
+/* Overview:
+	Set up the kernel's own caches. */
+void
+kmem_init(void)
+{
+	kmem_pgcache_init(&kmem_pgtables, "pgtable", 64, 0);
+}
+
+/* Overview:
+	Initialize the page cache `kp`, which keeps at most `max` pages. A
+	page that has to be taken from the page allocator is built with
+	`ctor` (or simply zeroed, if `ctor` is 0). */
+void
+kmem_pgcache_init(struct Kmem_pgcache *kp, const char *name, u_int max,
+				  void (*ctor)(void *va))
+{
+	kp->kp_name = name;
+	LIST_INIT(&kp->kp_list);
+	kp->kp_n = 0;
+	kp->kp_max = max;
+	kp->kp_ctor = ctor;
+	kp->kp_next = kmem_pgcaches;
+	kmem_pgcaches = kp;
+}
+
+/* Overview:
+	Get a constructed page from `kp`.
+
+  Post-Condition:
+	Return -E_NO_MEM if there is none and no free page either. Else set
+	*pp and return 0. As with page_alloc, `pp_ref` is not incremented. */
+int
+kmem_page_alloc(struct Kmem_pgcache *kp, struct Page **pp)
+{
+	struct Page *p;
+	int r;
+
+	if ((p = LIST_FIRST(&kp->kp_list)) != 0) {
+		LIST_REMOVE(p, pp_link);
+		kp->kp_n--;
+		*pp = p;
+		return 0;
+	}
+
+	if ((r = page_alloc(&p)) < 0) {
+		*pp = 0;
+		return r;
+	}
+	if (kp->kp_ctor) {
+		kp->kp_ctor((void *)page2kva(p));
+	}
+	*pp = p;
+	return 0;
+}
+
+/* Overview:
+	Drop a reference to `pp`, a page from `kp`. When the last one goes,
+	keep the page for reuse; the caller guarantees it is back in its
+	constructed state. */
+void
+kmem_page_put(struct Kmem_pgcache *kp, struct Page *pp)
+{
+	if (--pp->pp_ref > 0) {
+		return;
+	}
+	if (kp->kp_n >= kp->kp_max) {
+		page_free(pp);
+		return;
+	}
+	LIST_INSERT_HEAD(&kp->kp_list, pp, pp_link);
+	kp->kp_n++;
+}
+
+/* Overview:
+	Initialize the object cache `kc` for objects of `size` bytes, built
+	with `ctor` (which may be 0) when their page is carved. */
+void
+kmem_cache_init(struct Kmem_cache *kc, const char *name, u_int size,
+				void (*ctor)(void *obj))
+{
+	kc->kc_name = name;
+	// The free-list link lives just past the object, so that a free
+	// object keeps its constructed contents.
+	kc->kc_size = ROUND(size, sizeof(void *)) + sizeof(void *);
+	kc->kc_ctor = ctor;
+	kc->kc_free = 0;
+	kc->kc_nfree = 0;
+	kc->kc_npages = 0;
+
+	if (kc->kc_size > BY2PG) {
+		panic("kmem_cache_init: %s objects do not fit in a page", name);
+	}
+}
+
+#define KMEM_LINK(kc, obj)	\
+	(*(void **)((u_long)(obj) + (kc)->kc_size - sizeof(void *)))
+
+/* Overview:
+	Get a constructed object from `kc`, carving a new page into objects
+	when the cache is empty.
+
+  Post-Condition:
+	Return the object, or 0 if there is no memory. */
+void *
+kmem_cache_alloc(struct Kmem_cache *kc)
+{
+	struct Page *p;
+	u_long va, end;
+	void *obj;
+
+	if (kc->kc_free == 0) {
+		if (page_alloc(&p) < 0) {
+			return 0;
+		}
+		// Slab pages belong to the cache for good.
+		p->pp_ref++;
+		kc->kc_npages++;
+		va = page2kva(p);
+		for (end = va + BY2PG - kc->kc_size; va <= end; va += kc->kc_size) {
+			if (kc->kc_ctor) {
+				kc->kc_ctor((void *)va);
+			}
+			KMEM_LINK(kc, va) = kc->kc_free;
+			kc->kc_free = (void *)va;
+			kc->kc_nfree++;
+		}
+	}
+
+	obj = kc->kc_free;
+	kc->kc_free = KMEM_LINK(kc, obj);
+	kc->kc_nfree--;
+	return obj;
+}
+
+/* Overview:
+	Give `obj` back to `kc`, in its constructed state. */
+void
+kmem_cache_free(struct Kmem_cache *kc, void *obj)
+{
+	KMEM_LINK(kc, obj) = kc->kc_free;
+	kc->kc_free = obj;
+	kc->kc_nfree++;
+}
+
+/* Overview:
+	Give every page kept by the page caches back to the page allocator.
+
+  Post-Condition:
+	Return the number of pages released. */
+int
+kmem_reap(void)
+{
+	struct Kmem_pgcache *kp;
+	struct Page *p;
+	int n = 0;
+
+	for (kp = kmem_pgcaches; kp; kp = kp->kp_next) {
+		while ((p = LIST_FIRST(&kp->kp_list)) != 0) {
+			LIST_REMOVE(p, pp_link);
+			kp->kp_n--;
+			page_free(p);
+			n++;
+		}
+	}
+	return n;
+}
@@ -3,6 +3,10 @@
 #include "printf.h"
 #include "env.h"
 #include "error.h"
+#include "kmem.h"
+#include "swap.h"
+#include "kclock.h"
+#include "trace.h"
 
 
 int debug_mode = 0;
@@ -15,8 +19,15 @@ Pde *boot_pgdir;
 
 struct Page *pages;
 static u_long freemem;
+static Pte *zero_pt;		/* all zeros, seen through UVPT for missing tables */
 
-static struct Page_list page_free_list;	/* Free list of physical pages */
+/* Free blocks of physical pages, one list per order (see page_alloc_order). */
+static struct Page_list page_free_list[PAGE_NORDER];
+static int page_nocoalesce;	/* set while page_check has stolen the lists */
+
+/* Pages zeroed ahead of time, so that page_alloc need not clear them. */
+static struct Page_list page_zero_list;
+static u_int page_nzero;
 
 void set_debug()
 {
@@ -183,13 +194,36 @@ void mips_vm_init()
     boot_map_segment(pgdir, UENVS, n, PADDR(envs), PTE_R);
 	// does here need change ???????????
 
+    /* Step 4: The time page, which user code may only read. */
+    if (ROUND(npage * sizeof(struct Page), BY2PG) > UTIME - UPAGES) {
+        panic("mips_vm_init: pages run into UTIME");
+    }
+    timepage = (struct Timepage *)alloc(BY2PG, BY2PG, 1);
+    boot_map_segment(pgdir, UTIME, BY2PG, PADDR(timepage), 0);
+
+    /* Step 5: The empty page table, shown read-only through UVPT in place
+     * of the tables an env does not have (see do_refill). */
+    zero_pt = (Pte *)alloc(BY2PG, BY2PG, 1);
+
     printf("pmap.c:\t mips vm init success\n");
 }
 
+/* Overview:
+	Put the free block of (1 << order) pages starting at `pp` on its list. */
+static void
+buddy_insert(struct Page *pp, u_int order)
+{
+	pp->pp_order = order;
+	pp->pp_free = 1;
+	LIST_INSERT_HEAD(&page_free_list[order], pp, pp_link);
+}
+
 /*Overview:
  	Initialize page structure and memory free list.
  	The `pages` array has one `struct Page` entry per physical page. Pages
-	are reference counted, and free pages are kept on a linked list.
+	are reference counted, and free pages are kept by a buddy allocator:
+	free blocks of 2^order pages, aligned to their size, on one list per
+	order.
   Hint:
 	Use `LIST_INSERT_HEAD` to insert something to list.*/
 void
@@ -198,7 +232,12 @@ page_init(void)
     /* Step 1: Initialize page_free_list. */
     /* Hint: Use macro `LIST_INIT` defined in include/queue.h. */
 	extern char end[];
-	LIST_INIT(&page_free_list);
+	u_int order;
+
+	for (order = 0; order < PAGE_NORDER; order++) {
+		LIST_INIT(&page_free_list[order]);
+	}
+	LIST_INIT(&page_zero_list);
     /* Step 2: Align `freemem` up to multiple of BY2PG. */
 	freemem = ROUND(freemem, BY2PG);
     /* Step 3: Mark all memory blow `freemem` as used(set `pp_ref`
@@ -207,16 +246,75 @@ page_init(void)
 	int i = 0;
 	for (i=0;i<used_page;i++){
 		pages[i].pp_ref = 1;
+		pages[i].pp_free = 0;
 	}
-    /* Step 4: Mark the other memory as free. */
+    /* Step 4: Mark the other memory as free, in the largest aligned blocks
+     * that fit. */
 	for(;i<npage;i++){
 		pages[i].pp_ref = 0;
-		LIST_INSERT_HEAD(&page_free_list, &pages[i], pp_link);		// pp_link--->field
+		pages[i].pp_free = 0;
+	}
+	for (i = used_page; i < npage; i += 1 << order) {
+		for (order = PAGE_NORDER - 1; order > 0; order--) {
+			if ((i & ((1 << order) - 1)) == 0 && i + (1 << order) <= npage) {
+				break;
+			}
+		}
+		buddy_insert(&pages[i], order);
+	}
+}
+
+/* Overview:
+	Take a block of (1 << order) pages off the free lists, splitting a
+	larger one if needed. The contents are left as they are. */
+static int
+buddy_alloc(struct Page **pp, u_int order)
+{
+	struct Page *p;
+	u_int o;
+
+	for (o = order; o < PAGE_NORDER; o++) {
+		if (!LIST_EMPTY(&page_free_list[o])) {
+			break;
+		}
+	}
+	if (o >= PAGE_NORDER) {
+		*pp = 0;
+		return -E_NO_MEM;
+	}
+
+	p = LIST_FIRST(&page_free_list[o]);
+	LIST_REMOVE(p, pp_link);
+	p->pp_free = 0;
+
+	// Give back the upper half until the block is the size we want.
+	while (o > order) {
+		o--;
+		buddy_insert(p + (1 << o), o);
+	}
+
+	*pp = p;
+	return 0;
+}
+
+/* Overview:
+	Give the pages of the zeroed pool back to the free lists, so that they
+	can coalesce again. */
+static void
+page_zero_drain(void)
+{
+	struct Page *p;
+
+	while ((p = LIST_FIRST(&page_zero_list)) != 0) {
+		LIST_REMOVE(p, pp_link);
+		page_nzero--;
+		page_free_order(p, 0);
 	}
 }
 
 /*Overview:
 	Allocates a physical page from free memory, and clear this page.
+	A page from the pre-zeroed pool is used when there is one.
 
   Post-Condition:
 	If failed to allocate a new page(out of memory(there's no free page)),
@@ -225,36 +323,87 @@ page_init(void)
 
   Note:
  	Does NOT increment the reference count of the page - the caller must do
- 	these if necessary (either explicitly or via page_insert).
-
-  Hint:
-	Use LIST_FIRST and LIST_REMOVE defined in include/queue.h .*/
+ 	these if necessary (either explicitly or via page_insert).*/
 int
 page_alloc(struct Page **pp)
 {
-    struct Page *ppage_temp;
+	struct Page *p;
 
-    /* Step 1: Get a page from free memory. If fails, return the error code.*/
-	if (LIST_EMPTY(&page_free_list)) {
-		*pp = 0;
-		return -E_NO_MEM;
-	} else {
-		ppage_temp = LIST_FIRST(&page_free_list);
-		LIST_REMOVE(ppage_temp, pp_link);	// field is pp_link
+	if ((p = LIST_FIRST(&page_zero_list)) != 0) {
+		LIST_REMOVE(p, pp_link);
+		page_nzero--;
+		*pp = p;
+		return 0;
+	}
+	return page_alloc_order(pp, 0);
+}
+
+/*Overview:
+	Like page_alloc, but the page is NOT cleared: for callers that
+	overwrite all of it anyway (a copy-on-write copy, a full page loaded
+	from a binary). Zeroed pages are only used when nothing else is left.*/
+int
+page_alloc_nozero(struct Page **pp)
+{
+	if (buddy_alloc(pp, 0) == 0) {
+		return 0;
 	}
+	return page_alloc(pp);
+}
 
-    /* Step 2: Initialize this page.
-     * Hint: use `bzero`. */
-	// 清空指向的那一页，而非存储页面信息的结构体
-	bzero((void *)page2kva(ppage_temp), BY2PG);
-	*pp = ppage_temp;
+/*Overview:
+	Allocate (1 << order) physically contiguous pages, aligned to their
+	size, and clear them. The smallest free block that is large enough is
+	split, and the halves that are not needed go back on their lists.
+
+  Post-Condition:
+	Return -E_NO_MEM if there is no such block. Else set *pp to the first
+	page of the block and return 0.
+
+  Note:
+	Only the first page's `pp_ref` means anything: the block is released
+	as a whole with page_free_order, never page by page.*/
+int
+page_alloc_order(struct Page **pp, u_int order)
+{
+	if (buddy_alloc(pp, order) < 0) {
+		// Destroyed envs, the zeroed pool or the kernel caches may be
+		// holding the pages.
+		env_reap(NENV);
+		kmem_reap();
+		page_zero_drain();
+		// Failing that, push cold user pages out to the swap disk.
+		if (buddy_alloc(pp, order) < 0 &&
+			(swap_reclaim(SWAP_CLUSTER << order) == 0 ||
+			 buddy_alloc(pp, order) < 0)) {
+			return -E_NO_MEM;
+		}
+	}
+
+	bzero((void *)page2kva(*pp), BY2PG << order);
 	return 0;
 }
 
 /*Overview:
-	Release a page, mark it as free if it's `pp_ref` reaches 0.
-  Hint:
-	When to free a page, just insert it to the page_free_list.*/
+	Zero up to `n` free pages ahead of time, keeping at most PAGE_NZERO of
+	them. Called when the system has nothing better to do.*/
+void
+page_zero_refill(u_int n)
+{
+	struct Page *p;
+
+	for (; n > 0 && page_nzero < PAGE_NZERO; n--) {
+		if (buddy_alloc(&p, 0) < 0) {
+			return;
+		}
+		bzero((void *)page2kva(p), BY2PG);
+		LIST_INSERT_HEAD(&page_zero_list, p, pp_link);
+		page_nzero++;
+	}
+}
+
+/*Overview:
+	Release a page, mark it as free if it's `pp_ref` reaches 0.*/
 void
 page_free(struct Page *pp)
 {
@@ -262,7 +411,7 @@ page_free(struct Page *pp)
 	if(pp->pp_ref > 0) return ;
     /* Step 2: If the `pp_ref` reaches to 0, mark this page as free and return. */
 	else if (pp->pp_ref == 0) {
-		LIST_INSERT_HEAD(&page_free_list, pp, pp_link);
+		page_free_order(pp, 0);
 		return ;
 	}
 	else
@@ -271,6 +420,122 @@ page_free(struct Page *pp)
     panic("cgh:pp->pp_ref is less than zero\n");
 }
 
+/*Overview:
+	Release the block of (1 << order) pages starting at `pp`, merging it
+	with its buddy for as long as the buddy is free and of the same size.
+
+  Pre-Condition:
+	`pp` was returned by page_alloc_order(pp, order) (or page_alloc, for
+	order 0) and nothing refers to it any more.*/
+void
+page_free_order(struct Page *pp, u_int order)
+{
+	u_long ppn = page2ppn(pp), bppn;
+	struct Page *buddy;
+	u_int i;
+
+	// A free block starting anywhere inside this one means a double free.
+	for (i = 0; i < (1 << order); i++) {
+		if (pp[i].pp_free) {
+			panic("page_free_order: page %x is already free", page2pa(pp + i));
+		}
+	}
+
+	while (!page_nocoalesce && order < PAGE_NORDER - 1) {
+		bppn = ppn ^ (1 << order);
+		if (bppn >= npage) {
+			break;
+		}
+		buddy = &pages[bppn];
+		if (!buddy->pp_free || buddy->pp_order != order) {
+			break;
+		}
+		LIST_REMOVE(buddy, pp_link);
+		buddy->pp_free = 0;
+		ppn &= ~(1 << order);
+		order++;
+	}
+
+	buddy_insert(&pages[ppn], order);
+}
+
+/*Overview:
+	Print the number of free blocks of each order, for diagnosing
+	fragmentation.*/
+void
+page_free_report(void)
+{
+	struct Page *p;
+	u_int order, n, total = 0, largest = 0;
+
+	printf("free pages by order:");
+	for (order = 0; order < PAGE_NORDER; order++) {
+		n = 0;
+		LIST_FOREACH(p, &page_free_list[order], pp_link) {
+			n++;
+		}
+		if (n) {
+			largest = order;
+		}
+		total += n << order;
+		printf(" %d", n);
+	}
+	printf("\n%d pages free, largest block %d pages, %d pre-zeroed\n",
+		   total + page_nzero, 1 << largest, page_nzero);
+}
+
+/* Overview:
+	Take every free block off the lists into `fl`, so that page_check can
+	run against an empty allocator. Freed pages are not coalesced until
+	page_free_restore: their buddies may be sitting in `fl`. */
+static void
+page_free_steal(struct Page_list *fl)
+{
+	u_int order;
+
+	page_zero_drain();
+	for (order = 0; order < PAGE_NORDER; order++) {
+		fl[order] = page_free_list[order];
+		if (!LIST_EMPTY(&fl[order])) {
+			LIST_FIRST(&fl[order])->pp_link.le_prev = &LIST_FIRST(&fl[order]);
+		}
+		LIST_INIT(&page_free_list[order]);
+	}
+	page_nocoalesce = 1;
+}
+
+/* Overview:
+	Undo page_free_steal: put the blocks in `fl` back, then free again
+	whatever was freed in between so that it coalesces normally. */
+static void
+page_free_restore(struct Page_list *fl)
+{
+	struct Page_list freed[PAGE_NORDER];
+	struct Page *p;
+	u_int order;
+
+	for (order = 0; order < PAGE_NORDER; order++) {
+		freed[order] = page_free_list[order];
+		if (!LIST_EMPTY(&freed[order])) {
+			LIST_FIRST(&freed[order])->pp_link.le_prev = &LIST_FIRST(&freed[order]);
+		}
+		page_free_list[order] = fl[order];
+		if (!LIST_EMPTY(&page_free_list[order])) {
+			LIST_FIRST(&page_free_list[order])->pp_link.le_prev =
+				&LIST_FIRST(&page_free_list[order]);
+		}
+	}
+	page_nocoalesce = 0;
+
+	for (order = 0; order < PAGE_NORDER; order++) {
+		while ((p = LIST_FIRST(&freed[order])) != 0) {
+			LIST_REMOVE(p, pp_link);
+			p->pp_free = 0;
+			page_free_order(p, order);
+		}
+	}
+}
+
 /*Overview:
  	Given `pgdir`, a pointer to a page directory, pgdir_walk returns a pointer
  	to the page table entry (with permission PTE_R|PTE_V) for virtual address 'va'.
@@ -303,12 +568,14 @@ pgdir_walk(Pde *pgdir, u_long va, int create, Pte **ppte)
      * When creating new page table, maybe out of memory. */
 	if(create==1 && (*pgdir_entryp & PTE_V)==0) {
 		/*NOW create it*/
-		if(page_alloc(&ppage)==-E_NO_MEM){
+		if(kmem_page_alloc(&kmem_pgtables, &ppage)==-E_NO_MEM){
 			*ppte = 0;
 			return -E_NO_MEM;
 		}
 		ppage->pp_ref ++;
 		*pgdir_entryp = page2pa(ppage)|(PTE_V|PTE_R);
+		// The TLB may show zero_pt in its place through UVPT.
+		tlb_invalidate(pgdir, UVPT + (PDX(va) << PGSHIFT));
 	}
     /* Step 3: Set the page table entry to `*ppte` as return value. */
 	if((*pgdir_entryp)==0) {
@@ -342,6 +609,11 @@ page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm)
     /* Step 1: Get corresponding page table entry. */
     pgdir_walk(pgdir, va, 0, &pgtable_entry);
 
+    if (pgtable_entry != 0 && PTE_ISSWAP(*pgtable_entry)) {
+        swap_free(pgdir, *pgtable_entry);
+        *pgtable_entry = 0;
+    }
+
     if (pgtable_entry != 0 && (*pgtable_entry & PTE_V) != 0) { // have the correspond page table
         if (pa2page(*pgtable_entry) != pp) {	// have but not match
             page_remove(pgdir, va);
@@ -359,13 +631,17 @@ page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm)
 
 
     /* Step 3: Do check, re-get page table entry to validate the insertion. */
+    /* Take the reference first: allocating the page table may make the
+     * reclaimer look for pages to swap out, and `pp` must not be one. */
+	pp->pp_ref++;
 	if(pgdir_walk(pgdir, va, 1, &pgtable_entry) != 0){		// set create flag to 1
+		pp->pp_ref--;
 		return -E_NO_MEM;
 	}
     /* Step 3.1 Check if the page can be insert, if can’t return -E_NO_MEM */
 	/* Step 3.2 Insert page and increment the pp_ref */
 	*pgtable_entry = page2pa(pp) | PERM;
-	pp->pp_ref++;
+	pgdir_rss_add(pgdir, 1);
 	tlb_invalidate(pgdir, va);
     return 0;
 }
@@ -389,6 +665,10 @@ page_lookup(Pde *pgdir, u_long va, Pte **ppte)
     if (pte == 0) {
         return 0;
     }
+    /* A page out on the swap disk is brought back first. */
+    if (PTE_ISSWAP(*pte) && swap_in(pgdir, va, pte) < 0) {
+        return 0;
+    }
     if ((*pte & PTE_V) == 0) {
         return 0;    //the page is not in memory.
     }
@@ -419,6 +699,13 @@ page_remove(Pde *pgdir, u_long va)
     struct Page *ppage;
 
     /* Step 1: Get the page table entry, and check if the page table entry is valid. */
+    /* No point reading a swapped out page back just to drop it. */
+    pgdir_walk(pgdir, va, 0, &pagetable_entry);
+    if (pagetable_entry != 0 && PTE_ISSWAP(*pagetable_entry)) {
+        swap_free(pgdir, *pagetable_entry);
+        *pagetable_entry = 0;
+        return;
+    }
     ppage = page_lookup(pgdir, va, &pagetable_entry);
 
     if (ppage == 0) {
@@ -435,19 +722,370 @@ page_remove(Pde *pgdir, u_long va)
 
     /* Step 3: Update TLB. */
     *pagetable_entry = 0;
+    pgdir_rss_add(pgdir, -1);
     tlb_invalidate(pgdir, va);
     return;
 }
 
+/*Overview:
+	Return the page table entry for `va`, reusing the page table found by
+	the previous call while `va` stays inside it, so a caller stepping
+	through a range only walks the page directory once per page table.
+	`*pdx` caches the directory index of `*pt` and must start out as ~0.
+	If `create` is set a missing page table is allocated.
+
+  Post-Condition:
+	Return 0 and set *ppte (NULL when there is no page table and `create`
+	is clear), or -E_NO_MEM if a page table could not be allocated.*/
+static int
+range_walk(Pde *pgdir, u_long va, int create, u_long *pdx, Pte **pt, Pte **ppte)
+{
+    Pte *pte;
+
+    if (*pdx != PDX(va)) {
+        if (pgdir_walk(pgdir, va, create, &pte) < 0) {
+            return -E_NO_MEM;
+        }
+        *pdx = PDX(va);
+        *pt = pte ? pte - PTX(va) : 0;
+    }
+
+    *ppte = *pt ? &(*pt)[PTX(va)] : 0;
+    return 0;
+}
+
+/*Overview:
+	Allocate `npages` fresh pages and map them at [va, va + npages * BY2PG)
+	with permission `perm | PTE_V`, replacing whatever was mapped there.
+
+  Post-Condition:
+	Return the number of pages mapped, or -E_NO_MEM (pages mapped before
+	running out of memory stay mapped).*/
+int
+page_alloc_range(Pde *pgdir, u_long va, u_int npages, u_int perm)
+{
+    u_long pdx = ~0, start = va;
+    Pte *pt, *pte;
+    struct Page *pp;
+    u_int i;
+    int r = 0;
+
+    for (i = 0; i < npages; i++, va += BY2PG) {
+        if ((r = page_alloc(&pp)) < 0) {
+            break;
+        }
+        if ((r = range_walk(pgdir, va, 1, &pdx, &pt, &pte)) < 0) {
+            page_free(pp);
+            break;
+        }
+        if (*pte & PTE_V) {
+            page_decref(pa2page(*pte));
+        } else {
+            if (PTE_ISSWAP(*pte)) {
+                swap_free(pgdir, *pte);
+            }
+            pgdir_rss_add(pgdir, 1);
+        }
+        *pte = page2pa(pp) | perm | PTE_V;
+        pp->pp_ref++;
+    }
+
+    tlb_invalidate_range(pgdir, start, i);
+    return r < 0 ? r : i;
+}
+
+/*Overview:
+	Map the pages found at [srcva, srcva + npages * BY2PG) in `srcpgdir`
+	at the same offsets from `dstva` in `dstpgdir`, with permission
+	`perm | PTE_V`. Unmapped source pages are skipped.
+
+  Post-Condition:
+	Return the number of pages mapped, -E_INVAL if a read-only source page
+	would become writable, or -E_NO_MEM if a page table could not be
+	allocated.*/
+int
+page_map_range(Pde *srcpgdir, u_long srcva, Pde *dstpgdir, u_long dstva,
+               u_int npages, u_int perm)
+{
+    u_long spdx = ~0, dpdx = ~0, start = dstva;
+    Pte *spt, *dpt, *spte, *dpte;
+    struct Page *pp;
+    u_int i, n = 0;
+    int r = 0;
+
+    for (i = 0; i < npages; i++, srcva += BY2PG, dstva += BY2PG) {
+        range_walk(srcpgdir, srcva, 0, &spdx, &spt, &spte);
+        if (spte != 0 && PTE_ISSWAP(*spte) &&
+            (r = swap_in(srcpgdir, srcva, spte)) < 0) {
+            break;
+        }
+        if (spte == 0 || (*spte & PTE_V) == 0) {
+            continue;
+        }
+        /* A copy-on-write mapping never writes the shared page itself. */
+        if ((*spte & PTE_R) == 0 && (perm & (PTE_R | PTE_COW)) == PTE_R) {
+            r = -E_INVAL;
+            break;
+        }
+        /* Hold the page while a page table may be allocated for it. */
+        pp = pa2page(*spte);
+        pp->pp_ref++;
+        if ((r = range_walk(dstpgdir, dstva, 1, &dpdx, &dpt, &dpte)) < 0) {
+            pp->pp_ref--;
+            break;
+        }
+        if (*dpte & PTE_V) {
+            page_decref(pa2page(*dpte));
+        } else {
+            if (PTE_ISSWAP(*dpte)) {
+                swap_free(dstpgdir, *dpte);
+            }
+            pgdir_rss_add(dstpgdir, 1);
+        }
+        *dpte = page2pa(pp) | perm | PTE_V;
+        n++;
+    }
+
+    tlb_invalidate_range(dstpgdir, start, i);
+    return r < 0 ? r : n;
+}
+
+/*Overview:
+	Unmap every page in [va, va + npages * BY2PG); holes are skipped and
+	page tables that are not present are stepped over whole.
+
+  Post-Condition:
+	Return the number of pages that were actually unmapped.*/
+int
+page_remove_range(Pde *pgdir, u_long va, u_int npages)
+{
+    u_long end = va + npages * BY2PG, start = va;
+    Pte *pt;
+    u_int n = 0;
+
+    while (va < end) {
+        if ((pgdir[PDX(va)] & PTE_V) == 0) {
+            va = ROUNDDOWN(va, PDMAP) + PDMAP;
+            continue;
+        }
+        pt = (Pte *)KADDR(PTE_ADDR(pgdir[PDX(va)]));
+        do {
+            if (pt[PTX(va)] & PTE_V) {
+                page_decref(pa2page(pt[PTX(va)]));
+                pt[PTX(va)] = 0;
+                pgdir_rss_add(pgdir, -1);
+                n++;
+            } else if (PTE_ISSWAP(pt[PTX(va)])) {
+                swap_free(pgdir, pt[PTX(va)]);
+                pt[PTX(va)] = 0;
+                n++;
+            }
+            va += BY2PG;
+        } while (va < end && PTX(va) != 0);
+    }
+
+    tlb_invalidate_range(pgdir, start, npages);
+    return n;
+}
+
+/*Overview:
+	Resolve a write fault on the copy-on-write page at `va` without leaving
+	the kernel. If the page is still shared, copy it into a freshly allocated
+	page and map that one writable; if we are the last sharer (`pp_ref` is 1),
+	simply give the write permission back, no copy needed.
+
+  Post-Condition:
+	Return 0 on success, -E_INVAL if `va` is not a COW mapping,
+	-E_NO_MEM if no page could be allocated.*/
+int
+page_cow(Pde *pgdir, u_long va)
+{
+    Pte *pte;
+    struct Page *pp, *np;
+    u_int perm;
+    int r;
+
+    va = ROUNDDOWN(va, BY2PG);
+    pp = page_lookup(pgdir, va, &pte);
+
+    if (pp == 0 || (*pte & PTE_COW) == 0) {
+        return -E_INVAL;
+    }
+
+    perm = ((*pte & 0xfff) & ~PTE_COW) | PTE_R;
+
+    /* Last sharer: nobody else can observe the write. */
+    if (pp->pp_ref == 1) {
+        *pte = page2pa(pp) | perm;
+        tlb_invalidate(pgdir, va);
+        return 0;
+    }
+
+    /* A private copy is new memory, which an env at its limit cannot have. */
+    if (pgdir2env(pgdir) && (r = env_mem_check(pgdir2env(pgdir), 1)) < 0) {
+        return r;
+    }
+
+    if ((r = page_alloc_nozero(&np)) < 0) {
+        return r;
+    }
+
+    bcopy((void *)page2kva(pp), (void *)page2kva(np), BY2PG);
+
+    if ((r = page_insert(pgdir, np, va, perm)) < 0) {
+        page_free(np);
+        return r;
+    }
+
+    return 0;
+}
+
+/* Overview:
+	Find the page behind user address `va` of curenv for the kernel to
+	read or (if `write`) write through its kernel address, doing what a
+	user access would have done first: demand-zero memory gets its page,
+	a swapped-out page comes back in, a COW page is copied.
+
+  Post-Condition:
+	Return 0 and set *pp, -E_INVAL if the env may not access `va` that
+	way, or -E_NO_MEM. */
+static int
+user_page(u_long va, int write, struct Page **pp)
+{
+    Pte *pte;
+    u_int perm;
+    int r;
+
+    if (va >= UTOP) {
+        return -E_INVAL;
+    }
+    va = ROUNDDOWN(va, BY2PG);
+    if (pgdir_walk(curenv->env_pgdir, va, 0, &pte) == 0 && pte != 0 &&
+        PTE_ISSWAP(*pte)) {
+        if ((r = swap_in(curenv->env_pgdir, va, pte)) < 0) {
+            return r;
+        }
+    }
+    if ((*pp = page_lookup(curenv->env_pgdir, va, &pte)) == 0) {
+        if (env_region_lookup(curenv, va, &perm) < 0) {
+            return -E_INVAL;
+        }
+        if ((r = env_mem_check(curenv, 1)) < 0 || (r = page_alloc(pp)) < 0) {
+            return r;
+        }
+        if ((r = page_insert(curenv->env_pgdir, *pp, va, perm)) < 0) {
+            page_free(*pp);
+            return r;
+        }
+        *pp = page_lookup(curenv->env_pgdir, va, &pte);
+    }
+    if (write && (*pte & PTE_COW)) {
+        if ((r = page_cow(curenv->env_pgdir, va)) < 0) {
+            return r;
+        }
+        *pp = page_lookup(curenv->env_pgdir, va, &pte);
+    }
+    if (write && (*pte & PTE_R) == 0) {
+        return -E_INVAL;
+    }
+    return 0;
+}
+
+/* Overview:
+	Copy `len` bytes from the kernel at `src` to `va` in curenv. The copy
+	goes through curenv's page tables and kernel addresses, never through
+	the user mapping, so a bad pointer from a syscall cannot fault in the
+	kernel. Syscalls hand results back with this.
+
+  Post-Condition:
+	Return 0, or -E_INVAL if some of the range is not writable memory of
+	the env (part of it may have been written then), or -E_NO_MEM. */
+int
+copyout(u_long va, const void *src, u_int len)
+{
+    struct Page *pp;
+    u_int n;
+    int r;
+
+    for (; len > 0; va += n, src = (const char *)src + n, len -= n) {
+        if ((r = user_page(va, 1, &pp)) < 0) {
+            return r;
+        }
+        n = MIN(len, BY2PG - (va & (BY2PG - 1)));
+        bcopy(src, (void *)(page2kva(pp) + (va & (BY2PG - 1))), n);
+    }
+    return 0;
+}
+
+/* Overview:
+	Copy `len` bytes from `va` in curenv to the kernel at `dst`; see
+	copyout.
+
+  Post-Condition:
+	Return 0, or -E_INVAL if some of the range is not memory of the env,
+	or -E_NO_MEM. */
+int
+copyin(void *dst, u_long va, u_int len)
+{
+    struct Page *pp;
+    u_int n;
+    int r;
+
+    for (; len > 0; va += n, dst = (char *)dst + n, len -= n) {
+        if ((r = user_page(va, 0, &pp)) < 0) {
+            return r;
+        }
+        n = MIN(len, BY2PG - (va & (BY2PG - 1)));
+        bcopy((void *)(page2kva(pp) + (va & (BY2PG - 1))), dst, n);
+    }
+    return 0;
+}
+
 // Overview:
-// 	Update TLB.
+// 	Drop every TLB entry of the env that owns `pgdir`.
+void
+tlb_invalidate_pgdir(Pde *pgdir)
+{
+    struct Env *e = pgdir2env(pgdir);
+
+    if (e == 0) {
+        tlb_flush_asid(0);
+    } else if ((e->env_asid & ~ASID_MASK) != 0) {
+        tlb_flush_asid(ENV_ASID(e));
+    }
+}
+
+// Overview:
+// 	Update TLB: drop the entry for `va` under the ASID of the env that owns
+// 	`pgdir` (which need not be curenv). An env that has not run yet has
+// 	nothing in the TLB.
 void
 tlb_invalidate(Pde *pgdir, u_long va)
 {
-    if (curenv) {
-        tlb_out(PTE_ADDR(va) | GET_ENV_ASID(curenv->env_id));
-    } else {
+    struct Env *e = pgdir2env(pgdir);
+
+    if (e == 0) {
         tlb_out(PTE_ADDR(va));
+    } else if ((e->env_asid & ~ASID_MASK) != 0) {
+        tlb_out(PTE_ADDR(va) | ENV_ASID(e));
+    }
+}
+
+// Overview:
+// 	Update TLB for every page of [va, va + npages * BY2PG), after a range
+// 	operation has finished editing the page tables. A large range costs
+// 	one sweep of the TLB for the ASID rather than a probe per page.
+void
+tlb_invalidate_range(Pde *pgdir, u_long va, u_int npages)
+{
+    u_int i;
+
+    if (npages > TLB_RANGE_MAX) {
+        tlb_invalidate_pgdir(pgdir);
+    } else {
+        for (i = 0; i < npages; i++, va += BY2PG) {
+            tlb_invalidate(pgdir, va);
+        }
     }
 }
 
@@ -455,7 +1093,7 @@ void
 physical_memory_manage_check(void)
 {
     struct Page *pp, *pp0, *pp1, *pp2;
-    struct Page_list fl;
+    struct Page_list fl[PAGE_NORDER];
     int *temp;
 
     // should be able to allocate three pages
@@ -468,9 +1106,7 @@ physical_memory_manage_check(void)
     assert(pp1 && pp1 != pp0);
     assert(pp2 && pp2 != pp1 && pp2 != pp0);
     // temporarily steal the rest of the free pages
-    fl = page_free_list;
-    // now this page_free list must be empty!!!!
-    LIST_INIT(&page_free_list);
+    page_free_steal(fl);
     // should be no free memory
     assert(page_alloc(&pp) == -E_NO_MEM);
 
@@ -490,7 +1126,7 @@ physical_memory_manage_check(void)
     // pp0 should be zero
     assert(*temp == 0);
 
-    page_free_list = fl;
+    page_free_restore(fl);
     page_free(pp0);
     page_free(pp1);
     page_free(pp2);
@@ -541,12 +1177,100 @@ physical_memory_manage_check(void)
     printf("physical_memory_manage_check() succeeded\n");
 }
 
+/* Overview:
+	Count the free blocks of each order into `n`. */
+static void
+page_free_count(u_int *n)
+{
+    struct Page *p;
+    u_int order;
+
+    for (order = 0; order < PAGE_NORDER; order++) {
+        n[order] = 0;
+        LIST_FOREACH(p, &page_free_list[order], pp_link) {
+            n[order]++;
+        }
+    }
+}
+
+/* Overview:
+	Check the buddy allocator on a single free block of 16 pages: blocks
+	come out aligned to their size, split the way they should, and
+	coalesce back when freed.*/
+static void
+buddy_check(void)
+{
+    struct Page *blk, *pp, *pp1, *pp2;
+    struct Page_list fl[PAGE_NORDER];
+    u_int n[PAGE_NORDER], i;
+
+    // a block of 32 pages is aligned to 32 pages, and cleared
+    assert(page_alloc_order(&blk, 5) == 0);
+    assert(page2ppn(blk) % 32 == 0);
+    for (i = 0; i < 32; i++) {
+        assert(!blk[i].pp_free);
+        assert(*(u_int *)page2kva(&blk[i]) == 0);
+    }
+
+    // keep only its lower half free; the upper half, held, stops the
+    // lower one from merging with anything outside the test
+    page_free_steal(fl);
+    page_nocoalesce = 0;
+    page_free_order(blk, 4);
+    page_free_count(n);
+    for (i = 0; i < PAGE_NORDER; i++) {
+        assert(n[i] == (i == 4));
+    }
+
+    // one page splits the block into halves of 8, 4, 2 and 1 pages
+    assert(page_alloc_order(&pp, 0) == 0 && pp == blk);
+    page_free_count(n);
+    for (i = 0; i < PAGE_NORDER; i++) {
+        assert(n[i] == (i < 4));
+    }
+    assert(LIST_FIRST(&page_free_list[0]) == blk + 1);
+    assert(LIST_FIRST(&page_free_list[1]) == blk + 2);
+    assert(LIST_FIRST(&page_free_list[2]) == blk + 4);
+    assert(LIST_FIRST(&page_free_list[3]) == blk + 8);
+
+    // and freeing it puts the block back together
+    page_free_order(pp, 0);
+    page_free_count(n);
+    for (i = 0; i < PAGE_NORDER; i++) {
+        assert(n[i] == (i == 4));
+    }
+    assert(LIST_FIRST(&page_free_list[4]) == blk && blk->pp_order == 4);
+
+    // two blocks of 4 pages: aligned, the second is the buddy of the first
+    assert(page_alloc_order(&pp, 2) == 0 && pp == blk);
+    assert(page_alloc_order(&pp1, 2) == 0 && pp1 == blk + 4);
+    assert(page2ppn(pp1) % 4 == 0);
+    assert(buddy_alloc(&pp2, 3) == 0 && pp2 == blk + 8);
+    assert(buddy_alloc(&pp, 0) == -E_NO_MEM);
+    page_free_order(pp2, 3);
+
+    // freeing the first does not merge while its buddy is out ...
+    page_free_order(blk, 2);
+    page_free_count(n);
+    assert(n[2] == 1 && n[3] == 1 && n[4] == 0);
+
+    // ... and freeing the buddy merges all the way up
+    page_free_order(pp1, 2);
+    page_free_count(n);
+    for (i = 0; i < PAGE_NORDER; i++) {
+        assert(n[i] == (i == 4));
+    }
+
+    page_free_restore(fl);
+    page_free_order(blk + 16, 4);
+    printf("buddy_check() succeeded!\n");
+}
 
 void
 page_check(void)
 {
     struct Page *pp, *pp0, *pp1, *pp2;
-    struct Page_list fl;
+    struct Page_list fl[PAGE_NORDER];
 
     // should be able to allocate three pages
     pp0 = pp1 = pp2 = 0;
@@ -559,9 +1283,7 @@ page_check(void)
     assert(pp2 && pp2 != pp1 && pp2 != pp0);
 
     // temporarily steal the rest of the free pages
-    fl = page_free_list;
-    // now this page_free list must be empty!!!!
-    LIST_INIT(&page_free_list);
+    page_free_steal(fl);
 
     // should be no free memory
     assert(page_alloc(&pp) == -E_NO_MEM);
@@ -643,41 +1365,86 @@ page_check(void)
     pp0->pp_ref = 0;
 
     // give free list back
-    page_free_list = fl;
+    page_free_restore(fl);
 
     // free the pages we took
     page_free(pp0);
     page_free(pp1);
     page_free(pp2);
 
+    buddy_check();
+    page_free_report();
     printf("page_check() succeeded!\n");
 }
 
-void pageout(int va, int context)
+/* Overview:
+	Slow path of the TLB refill handler (see handle_tlb in genex.S), for a
+	miss on an address with no valid PTE. If the address is demand-zero
+	memory of the env (see env_region_lookup), map a zeroed page there and
+	let the faulting instruction run again, refilling through the fast
+	path this time. Otherwise the env touched memory it never had, or had
+	the kernel touch it on its behalf: kill it.*/
+void
+do_refill(struct Trapframe *tf)
 {
-    u_long r;
-    struct Page *p = NULL;
+    u_long va = tf->cp0_badvaddr;
+    struct Page *p = 0;
+    Pte *pte;
+    u_int perm;
 
-	if(debug_mode) printf("[DEBUG] va: 0x%x\n",va);
-    if (context < 0x80000000) {
-        panic("tlb refill and alloc error!");
+    if (curenv == 0) {
+        panic("tlb miss at %x, pc %x, with no page behind it", va, tf->cp0_epc);
     }
 
-    if ((va > 0x7f400000) && (va < 0x7f800000)) {
-        panic(">>>>>>>>>>>>>>>>>>>>>>it's env's zone");
+    // Looking through UVPT at a page table that does not exist yet: show
+    // the shared empty one, read-only and in the TLB only, so that the
+    // lookup reads all zeros without costing the env a page. pgdir_walk
+    // drops the entry when a real table takes the slot.
+    if (va >= UVPT && va < UVPT + PDMAP && PTX(va) < PDX(UTOP)) {
+        tlb_write(PTE_ADDR(va) | ENV_ASID(curenv), PADDR(zero_pt) | PTE_V);
+        return;
     }
 
-    if (va < 0x10000) {
-		panic("^^^^^^TOO LOW^^^^^^^^^");
+    // The page was swapped out.
+    if (va < UTOP && pgdir_walk(curenv->env_pgdir, va, 0, &pte) == 0 &&
+        pte != 0 && PTE_ISSWAP(*pte)) {
+        TRACE(TR_FAULT, curenv->env_id, va, TRF_SWAP);
+        if (swap_in(curenv->env_pgdir, va, pte) < 0) {
+            printf("[%08x] fault at va %x: cannot swap the page in\n",
+                   curenv->env_id, va);
+            env_destroy(curenv);
+        }
+        return;
     }
 
-    if ((r = page_alloc(&p)) < 0) {
-        panic ("page alloc error!");
+    if (va >= UTOP || env_region_lookup(curenv, va, &perm) < 0) {
+        // Envs run with KUc clear too, so only the pc tells the kernel
+        // apart. It may follow a bad user pointer (a syscall argument, the
+        // exception stack), which is the env's fault; but no user pointer
+        // gets past ULIM.
+        if (tf->cp0_epc >= ULIM && va >= ULIM) {
+            panic("kernel touched unmapped va %x at pc %x for env %08x",
+                  va, tf->cp0_epc, curenv->env_id);
+        }
+        printf("[%08x] fault at va %x pc %x: nothing mapped there\n",
+               curenv->env_id, va, tf->cp0_epc);
+        env_destroy(curenv);
+        return;
     }
 
-    // p->pp_ref++;
+    TRACE(TR_FAULT, curenv->env_id, va, TRF_ZERO);
+    if (env_mem_check(curenv, 1) < 0) {
+        printf("[%08x] fault at va %x: over its memory limit of %d pages\n",
+               curenv->env_id, va, curenv->env_mem_limit);
+        env_destroy(curenv);
+        return;
+    }
 
-    page_insert((Pde *)context, p, VA2PFN(va), PTE_R);
-    printf("pageout:\t@@@___0x%x___@@@  ins a page \n", va);
+    if (page_alloc(&p) < 0 || page_insert(curenv->env_pgdir, p, va, perm) < 0) {
+        if (p) {
+            page_free(p);
+        }
+        printf("[%08x] fault at va %x: out of memory\n", curenv->env_id, va);
+        env_destroy(curenv);
+    }
 }
-
@@ -0,0 +1,257 @@
+#include "mmu.h"
+#include "pmap.h"
+#include "env.h"
+#include "swap.h"
+#include "printf.h"
+#include "error.h"
+
+/* The gxemul disk controller, seen through kseg1. */
+#define IDE_BASE	0xb3000000
+#define IDE_OFFSET	0x0000
+#define IDE_ID		0x0010
+#define IDE_OP		0x0020
+#define IDE_STATUS	0x0030
+#define IDE_BUFFER	0x4000
+#define IDE_SECT	512
+
+#define IDE_REG(off, type)	(*(volatile type *)(IDE_BASE + (off)))
+
+static u_int swap_map[SWAP_NSLOT / 32];	// bit set: slot in use
+static u_int swap_nslot;				// 0 when there is no swap disk
+static u_int swap_nfree;
+static u_int swap_hint;					// where to look for a free slot
+
+// The reclaimer's clock hand: the next page it looks at.
+static u_int swap_hand_env;
+static u_long swap_hand_va;
+
+static u_char swap_save[IDE_SECT];
+
+/* Overview:
+	Move one page between `va` and swap slot `slot`, a sector at a time.
+	The file system server drives the same controller from user mode with
+	one syscall per register, and may be preempted half way through a
+	request; its registers and sector buffer are put back afterwards.
+
+  Post-Condition:
+	Return 0, or -E_UNSPECIFIED if the disk refused a sector. */
+static int
+swap_io(u_int slot, u_char *va, int write)
+{
+	u_int id, offset, i;
+	int r = 0;
+
+	id = IDE_REG(IDE_ID, u_int);
+	offset = IDE_REG(IDE_OFFSET, u_int);
+	bcopy((void *)(IDE_BASE + IDE_BUFFER), swap_save, IDE_SECT);
+
+	for (i = 0; i < BY2PG; i += IDE_SECT) {
+		IDE_REG(IDE_ID, u_int) = SWAP_DISKNO;
+		IDE_REG(IDE_OFFSET, u_int) = slot * BY2PG + i;
+		if (write) {
+			bcopy(va + i, (void *)(IDE_BASE + IDE_BUFFER), IDE_SECT);
+		}
+		IDE_REG(IDE_OP, u_char) = write ? 1 : 0;
+		if (IDE_REG(IDE_STATUS, u_char) == 0) {
+			r = -E_UNSPECIFIED;
+			break;
+		}
+		if (!write) {
+			bcopy((void *)(IDE_BASE + IDE_BUFFER), va + i, IDE_SECT);
+		}
+	}
+
+	bcopy(swap_save, (void *)(IDE_BASE + IDE_BUFFER), IDE_SECT);
+	IDE_REG(IDE_OFFSET, u_int) = offset;
+	IDE_REG(IDE_ID, u_int) = id;
+	return r;
+}
+
+/* Overview:
+	Look for the swap disk, by reading the last sector it should have,
+	and start with every slot free. Without one, swap_reclaim simply finds
+	nothing to do. */
+void
+swap_init(void)
+{
+	u_int id, offset;
+
+	id = IDE_REG(IDE_ID, u_int);
+	offset = IDE_REG(IDE_OFFSET, u_int);
+	IDE_REG(IDE_ID, u_int) = SWAP_DISKNO;
+	IDE_REG(IDE_OFFSET, u_int) = SWAP_NSLOT * BY2PG - IDE_SECT;
+	IDE_REG(IDE_OP, u_char) = 0;
+	if (IDE_REG(IDE_STATUS, u_char) != 0) {
+		swap_nslot = SWAP_NSLOT;
+	}
+	IDE_REG(IDE_OFFSET, u_int) = offset;
+	IDE_REG(IDE_ID, u_int) = id;
+
+	bzero(swap_map, sizeof(swap_map));
+	swap_nfree = swap_nslot;
+	printf("swap: %d KB on disk %d\n", swap_nslot * BY2PG / 1024, SWAP_DISKNO);
+}
+
+static int
+swap_slot_alloc(void)
+{
+	u_int i, slot;
+
+	if (swap_nfree == 0) {
+		return -E_NO_MEM;
+	}
+	for (i = 0; i < swap_nslot; i++) {
+		slot = (swap_hint + i) % swap_nslot;
+		if ((swap_map[slot / 32] & (1 << (slot % 32))) == 0) {
+			swap_map[slot / 32] |= 1 << (slot % 32);
+			swap_nfree--;
+			swap_hint = slot + 1;
+			return slot;
+		}
+	}
+	panic("swap_slot_alloc: %d slots free but none found", swap_nfree);
+	return -E_NO_MEM;
+}
+
+static void
+swap_slot_release(u_int slot)
+{
+	if (slot >= swap_nslot || (swap_map[slot / 32] & (1 << (slot % 32))) == 0) {
+		panic("swap_slot_release: slot %d is not in use", slot);
+	}
+	swap_map[slot / 32] &= ~(1 << (slot % 32));
+	swap_nfree++;
+}
+
+/* Overview:
+	Write the page mapped by `*pte` at `va` out to a fresh slot and leave
+	a swap entry in its place.
+
+  Pre-Condition:
+	The page is mapped nowhere else (`pp_ref` is 1). */
+static int
+swap_out(Pde *pgdir, u_long va, Pte *pte)
+{
+	struct Page *pp = pa2page(*pte);
+	int slot;
+
+	if ((slot = swap_slot_alloc()) < 0) {
+		return slot;
+	}
+	if (swap_io(slot, (u_char *)page2kva(pp), 1) < 0) {
+		swap_slot_release(slot);
+		return -E_UNSPECIFIED;
+	}
+
+	*pte = (slot << PGSHIFT) | (*pte & 0xfff & ~(PTE_V | PTE_A)) | PTE_SWAP;
+	tlb_invalidate(pgdir, va);
+	page_decref(pp);
+	pgdir_rss_add(pgdir, -1);
+	pgdir2env(pgdir)->env_nswap++;
+	return 0;
+}
+
+/* Overview:
+	Advance the clock hand over user address spaces and swap out up to `n`
+	pages that have not been referenced since the hand last passed them.
+	Only private anonymous pages are taken: shared pages (`pp_ref` above
+	1, or PTE_LIBRARY) stay where they are. The sweep gives up after going
+	round twice.
+
+  Post-Condition:
+	Return the number of pages freed. */
+int
+swap_reclaim(u_int n)
+{
+	u_int budget, freed = 0;
+	struct Env *e;
+	Pte *pte;
+	u_long va;
+
+	if (swap_nfree == 0) {
+		return 0;
+	}
+
+	budget = 2 * (npage + NENV * PDX(UTOP));
+	for (; freed < n && budget > 0; budget--) {
+		e = &envs[swap_hand_env];
+		if (e->env_status == ENV_FREE || e->env_pgdir == 0 ||
+			swap_hand_va >= UTOP) {
+			swap_hand_env = (swap_hand_env + 1) % NENV;
+			swap_hand_va = 0;
+			continue;
+		}
+		if ((e->env_pgdir[PDX(swap_hand_va)] & PTE_V) == 0) {
+			swap_hand_va = ROUNDDOWN(swap_hand_va, PDMAP) + PDMAP;
+			continue;
+		}
+
+		va = swap_hand_va;
+		swap_hand_va += BY2PG;
+		pte = (Pte *)KADDR(PTE_ADDR(e->env_pgdir[PDX(va)])) + PTX(va);
+		if ((*pte & PTE_V) == 0 || (*pte & (PTE_LIBRARY | PTE_UC)) != 0 ||
+			PPN(*pte) >= npage || pa2page(*pte)->pp_ref != 1) {
+			continue;
+		}
+
+		// Referenced since the last pass: second chance. Drop the TLB
+		// entry, so the next access goes through the refill handler and
+		// marks the page again.
+		if (*pte & PTE_A) {
+			*pte &= ~PTE_A;
+			tlb_invalidate(e->env_pgdir, va);
+			continue;
+		}
+
+		if (swap_out(e->env_pgdir, va, pte) < 0) {
+			break;
+		}
+		freed++;
+	}
+
+	return freed;
+}
+
+/* Overview:
+	Bring the page behind the swap entry `*pte` (mapped at `va` in
+	`pgdir`) back into memory, with the permission it had.
+
+  Post-Condition:
+	Return 0, -E_NO_MEM if there is no page to read it into, or
+	-E_UNSPECIFIED if the disk fails; the swap entry is untouched then. */
+int
+swap_in(Pde *pgdir, u_long va, Pte *pte)
+{
+	struct Page *pp;
+	int r;
+
+	if ((r = page_alloc_nozero(&pp)) < 0) {
+		return r;
+	}
+	if (swap_io(SWAP_SLOT(*pte), (u_char *)page2kva(pp), 0) < 0) {
+		page_free(pp);
+		return -E_UNSPECIFIED;
+	}
+
+	swap_slot_release(SWAP_SLOT(*pte));
+	*pte = page2pa(pp) | (*pte & 0xfff & ~PTE_SWAP) | PTE_V;
+	pp->pp_ref++;
+	tlb_invalidate(pgdir, va);
+	pgdir_rss_add(pgdir, 1);
+	if (pgdir2env(pgdir)) {
+		pgdir2env(pgdir)->env_nswap--;
+	}
+	return 0;
+}
+
+/* Overview:
+	Give back the slot of swap entry `pte` in `pgdir`, whose page is no
+	longer wanted. */
+void
+swap_free(Pde *pgdir, Pte pte)
+{
+	swap_slot_release(SWAP_SLOT(pte));
+	if (pgdir2env(pgdir)) {
+		pgdir2env(pgdir)->env_nswap--;
+	}
+}
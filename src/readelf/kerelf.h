@@ -108,6 +108,26 @@ typedef struct{
         Elf32_Word sh_entsize;              /* Section entry size */
 }Elf32_Shdr;
 
+/* Legal values for sh_type (section type).  */
+
+#define SHT_SYMTAB      2               /* Symbol table */
+#define SHT_STRTAB      3               /* String table */
+
+
+/* Symbol table entry.  */
+typedef struct {
+        Elf32_Word      st_name;                /* Symbol name (string tbl index) */
+        Elf32_Addr      st_value;               /* Symbol value */
+        Elf32_Word      st_size;                /* Symbol size */
+        unsigned char   st_info;                /* Symbol type and binding */
+        unsigned char   st_other;               /* Symbol visibility */
+        Elf32_Section   st_shndx;               /* Section index */
+} Elf32_Sym;
+
+#define ELF32_ST_TYPE(val)      ((val) & 0xf)
+
+#define STT_FUNC        2               /* Symbol is a code object */
+
 
 /* Program segment header.  */
 
@@ -1,13 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 extern int readelf(u_char* binary, int size);
+extern int readelf_syms(u_char* binary, int size);
 /*
         overview: input a elf format file name from control line, call the readelf function
-                  to parse it.
+                  to parse it. With -s before the name, list its functions instead.
         params:
                 argc: the number of parameters
-                argv: array of parameters, argv[1] shuold be the file name.
+                argv: array of parameters, argv[1] shuold be the file name, or -s
+                      and argv[2] the file name.
 
 */
 int main(int argc,char *argv[])
@@ -15,7 +18,14 @@ int main(int argc,char *argv[])
         FILE* fp;
         int fsize;
         unsigned char *p;
+        int syms = 0;
 
+        if(argc >= 2 && strcmp(argv[1], "-s") == 0)
+        {
+                syms = 1;
+                argc--;
+                argv++;
+        }
 
         if(argc < 2)
         {
@@ -40,6 +50,8 @@ int main(int argc,char *argv[])
         p[fsize] = 0;
 
 
+	if(syms)
+		return readelf_syms(p,fsize) < 0;
 	readelf(p,fsize);
         return 0;
 }
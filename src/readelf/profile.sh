@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Turn a dump of user/prof into a flat profile of one program: samples per
+# function, busiest first. The functions come from `readelf -s` (run make
+# here first); a pc is charged to the nearest function at or below it.
+#
+# usage: profile.sh dump binary [envid]
+#
+# Without an envid every env in the dump is taken to be running `binary`.
+
+dir=$(dirname "$0")
+
+if [ $# -lt 2 ] || [ $# -gt 3 ]; then
+	echo "usage: $0 dump binary [envid]" >&2
+	exit 1
+fi
+
+syms=$(mktemp) || exit 1
+trap 'rm -f "$syms"' EXIT
+
+"$dir/readelf" -s "$2" > "$syms" || { cat "$syms" >&2; exit 1; }
+
+awk -v envid="$3" '
+function hex(s,    i, v) {
+	v = 0
+	s = tolower(s)
+	for (i = 1; i <= length(s); i++)
+		v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+	return v
+}
+
+# readelf -s: address size name
+NR == FNR { addr[nsym] = hex($1); name[nsym] = $3; nsym++; next }
+
+# prof: envid pc count; anything else is console noise
+$0 !~ /^[0-9a-f]+ [0-9a-f]+ [0-9]+$/ { next }
+envid != "" && $1 != envid { next }
+{
+	pc = hex($2)
+	best = -1
+	for (i = 0; i < nsym; i++)
+		if (addr[i] <= pc && (best < 0 || addr[i] > addr[best]))
+			best = i
+	f = best < 0 ? sprintf("[%s]", $2) : name[best]
+	samples[f] += $3
+	total += $3
+}
+
+END {
+	if (total == 0) {
+		print "no samples"
+		exit
+	}
+	printf "%d samples\n", total
+	for (f in samples)
+		printf "%8d %5.1f%%  %s\n", samples[f], 100 * samples[f] / total, f | "sort -rn"
+	close("sort -rn")
+}' "$syms" "$1"
@@ -73,3 +73,46 @@ int readelf(u_char *binary, int size)
         return 0;
 }
 
+
+/* Overview:
+ *   List the functions in the symbol table of an ELF file, one per line:
+ * address and size in hex, then the name. src/readelf/profile.sh reads
+ * this to symbolize profile samples.
+ *
+ * Pre-Condition:
+ *   `binary` can't be NULL and `size` is the size of binary.
+ *
+ * Post-Condition:
+ *   Return 0 if success, -1 if `binary` is not an ELF file.
+ */
+int readelf_syms(u_char *binary, int size)
+{
+        Elf32_Ehdr *ehdr = (Elf32_Ehdr *)binary;
+        Elf32_Shdr *shdr, *strtab;
+        Elf32_Sym *sym;
+        int i, j;
+
+        if (size < sizeof(Elf32_Ehdr) || !is_elf_format(binary)) {
+                printf("not a standard elf format\n");
+                return -1;
+        }
+
+        for (i = 0; i < ehdr->e_shnum; i++) {
+                shdr = (Elf32_Shdr *)(binary + ehdr->e_shoff + i * ehdr->e_shentsize);
+                if (shdr->sh_type != SHT_SYMTAB) {
+                        continue;
+                }
+                strtab = (Elf32_Shdr *)(binary + ehdr->e_shoff +
+                                        shdr->sh_link * ehdr->e_shentsize);
+                for (j = 0; j < shdr->sh_size / sizeof(Elf32_Sym); j++) {
+                        sym = (Elf32_Sym *)(binary + shdr->sh_offset) + j;
+                        if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC) {
+                                continue;
+                        }
+                        printf("%08x %08x %s\n", sym->st_value, sym->st_size,
+                               (char *)binary + strtab->sh_offset + sym->st_name);
+                }
+        }
+
+        return 0;
+}
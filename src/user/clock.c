@@ -0,0 +1,44 @@
+// Reading the time page the kernel keeps at UTIME.
+
+#include "lib.h"
+
+extern struct Timepage *timepage;
+
+// Overview:
+//	Read the time since boot, as of the kernel's last clock tick or
+//	context switch, without a syscall.
+void
+clock_now(u_int *sec, u_int *usec)
+{
+	u_int seq, s, us;
+
+	do {
+		seq = timepage->tp_seq;
+		s = timepage->tp_sec;
+		us = timepage->tp_usec;
+	} while ((seq & 1) || seq != timepage->tp_seq);
+
+	if (sec)
+		*sec = s;
+	if (usec)
+		*usec = us;
+}
+
+// Overview:
+//	The time since boot in milliseconds (it wraps after 49 days).
+u_int
+clock_ms(void)
+{
+	u_int sec, usec;
+
+	clock_now(&sec, &usec);
+	return sec * 1000 + usec / 1000;
+}
+
+// Overview:
+//	The number of clock ticks since boot.
+u_int
+clock_ticks(void)
+{
+	return timepage->tp_ticks;
+}
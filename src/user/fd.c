@@ -83,7 +83,8 @@ fd_lookup(int fdnum, struct Fd **fd)
 
 	va = INDEX2FD(fdnum);
 
-	if (((* vpt)[va / BY2PG] & PTE_V) != 0) {	//the fd is used
+	if (((* vpd)[va / PDMAP] & PTE_V) != 0 &&
+		((* vpt)[va / BY2PG] & PTE_V) != 0) {	//the fd is used
 		*fd = (struct Fd *)va;
 		return 0;
 	}
@@ -139,7 +140,7 @@ int
 dup(int oldfdnum, int newfdnum)
 {
 	int i, r;
-	u_int ova, nva, pte;
+	u_int ova, nva, n, perm;
 	struct Fd *oldfd, *newfd;
 
 	if ((r = fd_lookup(oldfdnum, &oldfd)) < 0) {
@@ -157,17 +158,20 @@ dup(int oldfdnum, int newfdnum)
 		goto err;
 	} */
 
+	// Map the data pages a run of identical permissions at a time.
 	if ((* vpd)[PDX(ova)]) {
-		for (i = 0; i < PDMAP; i += BY2PG) {
-			pte = (* vpt)[VPN(ova + i)];
-
-			if (pte & PTE_V) {
-				// should be no error here -- pd is already allocated
-				if ((r = syscall_mem_map(0, ova + i, 0, nva + i,
-										 pte & (PTE_V | PTE_R | PTE_LIBRARY))) < 0) {
-					goto err;
+		for (i = 0; i < PDMAP; i += n * BY2PG) {
+			perm = (* vpt)[VPN(ova + i)] & (PTE_V | PTE_R | PTE_LIBRARY);
+			for (n = 1; i + n * BY2PG < PDMAP; n++) {
+				if (((* vpt)[VPN(ova + i + n * BY2PG)] &
+					 (PTE_V | PTE_R | PTE_LIBRARY)) != perm) {
+					break;
 				}
 			}
+			if ((perm & PTE_V) &&
+				(r = syscall_mem_map_range(ova + i, 0, nva + i, n, perm)) < 0) {
+				goto err;
+			}
 		}
 	}
 	if ((r = syscall_mem_map(0, (u_int)oldfd, 0, (u_int)newfd,
@@ -179,10 +183,7 @@ dup(int oldfdnum, int newfdnum)
 
 err:
 	syscall_mem_unmap(0, (u_int)newfd);
-
-	for (i = 0; i < PDMAP; i += BY2PG) {
-		syscall_mem_unmap(0, nva + i);
-	}
+	syscall_mem_unmap_range(0, nva, PDMAP / BY2PG);
 	return r;
 }
 
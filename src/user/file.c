@@ -55,6 +55,15 @@ open(const char *path, int mode)
 	size = (ffd->f_file).f_size;
 	// Step 4: Map the file content into memory.
 	if(size == 0) return fd2num(fd);
+	if(mode & O_EXEC) {
+		// One request maps the whole (shared, read-only) image.
+		r = fsipc_map_exec(fileid, va);
+		if(r<0) {
+			writef("[DEBUG] open: map exec failed!\n");
+			return r;
+		}
+		return fd2num(fd);
+	}
 	for(i=0;i<size;i+=BY2PG) {
 		r = fsipc_map(fileid, i, va+i);
 		if(r<0) {
@@ -84,9 +93,12 @@ file_close(struct Fd *fd)
 	// Set the start address storing the file's content.
 	va = fd2data(fd);
 
-	// Tell the file server the dirty page.
-	for (i = 0; i < size; i += BY2PG) {
-		fsipc_dirty(fileid, i);
+	// Tell the file server the dirty page. A read-only open cannot have
+	// written anything, so spare the server one request per page.
+	if ((fd->fd_omode & O_ACCMODE) != O_RDONLY) {
+		for (i = 0; i < size; i += BY2PG) {
+			fsipc_dirty(fileid, i);
+		}
 	}
 
 	// Request the file server to close the file with fsipc.
@@ -99,11 +111,9 @@ file_close(struct Fd *fd)
 	if (size == 0) {
 		return 0;
 	}
-	for (i = 0; i < size; i += BY2PG) {
-		if ((r = syscall_mem_unmap(0, va + i)) < 0) {
-			writef("cannont unmap the file.\n");
-			return r;
-		}
+	if ((r = syscall_mem_unmap_range(0, va, ROUND(size, BY2PG) / BY2PG)) < 0) {
+		writef("cannont unmap the file.\n");
+		return r;
 	}
 	return 0;
 }
@@ -251,10 +261,12 @@ ftruncate(int fdnum, u_int size)
 	}
 
 	// Unmap pages if truncating the file
-	for (i = ROUND(size, BY2PG); i < ROUND(oldsize, BY2PG); i += BY2PG)
-		if ((r = syscall_mem_unmap(0, va + i)) < 0) {
-			user_panic("ftruncate: syscall_mem_unmap %08x: %e", va + i, r);
-		}
+	i = ROUND(size, BY2PG);
+	if (i < ROUND(oldsize, BY2PG) &&
+		(r = syscall_mem_unmap_range(0, va + i,
+									 (ROUND(oldsize, BY2PG) - i) / BY2PG)) < 0) {
+		user_panic("ftruncate: syscall_mem_unmap_range %08x: %e", va + i, r);
+	}
 
 	return 0;
 }
@@ -117,12 +117,13 @@ pgfault(u_int va)
 }
 
 /* Overview:
- * 	Map our virtual page `pn` (address pn*BY2PG) into the target `envid`
- * at the same virtual address. 
+ * 	Map our `npages` virtual pages starting at page `pn` (address
+ * pn*BY2PG) into the target `envid` at the same virtual addresses.
+ * All of them must carry the same permission bits `perm`.
  *
  * Post-Condition:
- *  if the page is writable or copy-on-write, the new mapping must be 
- * created copy on write and then our mapping must be marked 
+ *  if the pages are writable or copy-on-write, the new mappings must be 
+ * created copy on write and then our mappings must be marked 
  * copy on write as well. In another word, both of the new mapping and
  * our mapping should be copy-on-write if the page is writable or 
  * copy-on-write.
@@ -133,29 +134,29 @@ pgfault(u_int va)
  * should process it correctly.
  */
 static void
-duppage(u_int envid, u_int pn)
+duppage(u_int envid, u_int pn, u_int npages, u_int perm)
 {
 	u_int addr;
-	u_int perm;
-	int ret = 0;
-	
-	// vpd -> pde[]
-	// vpt -> pte[]
-	Pte * ppte = vpt[pn];
-	perm = (*vpt)[pn] & 0xfff;
+
 	addr = pn*BY2PG;
 
+	// A page out on the swap disk is mapped like any other: the kernel
+	// reads it back in before sharing it.
+	if((perm & (PTE_V|PTE_SWAP)) == PTE_SWAP) {
+		perm = (perm & ~PTE_SWAP) | PTE_V;
+	}
+
 	if(perm & PTE_V) {
 		if((perm & PTE_R)&&!(perm&PTE_LIBRARY)&&!(perm&PTE_COW)){
 			perm = perm | PTE_COW;
-			if(syscall_mem_map(0,addr,envid,addr,perm)!=0) {
+			if(syscall_mem_map_range(addr,envid,addr,npages,perm)<0) {
 				user_panic("[DEBUG] fork.c duppage: syscall_mem_map1!\n");
 			} 
-			if(syscall_mem_map(0,addr,0,addr,perm)!=0) {
+			if(syscall_mem_map_range(addr,0,addr,npages,perm)<0) {
 				user_panic("[DEBUG] fork.c duppage: syscall_mem_map2!\n");
 			}
 		} else {
-			if(syscall_mem_map(0,addr,envid,addr,perm)!=0) {
+			if(syscall_mem_map_range(addr,envid,addr,npages,perm)<0) {
 				user_panic("[DEBUG] fork.c suppage: syscall_mem_map3!\n");
 			}
 		}
@@ -163,7 +164,6 @@ duppage(u_int envid, u_int pn)
 }
 
 
-
 	/*
 	if(perm & PTE_V) {
 		if((perm & PTE_R) || (perm & PTE_COW)) {
@@ -247,7 +247,7 @@ fork(void)
 	u_int newenvid;
 	extern struct Env *envs;
 	extern struct Env *env;
-	u_int i;
+	u_int i, n, pn, perm;
 
 	//The parent installs pgfault using set_pgfault_handler
 	set_pgfault_handler(pgfault);						// what does va/pgfault use here?
@@ -256,13 +256,26 @@ fork(void)
 	
 	if(newenvid == 0) {
 		// child 
-		env = &(envs[ENVX(syscall_getenvid())]);
+		env = &(envs[ENVX(uinfo->ui_envid)]);
 	} else {
 		// father
-		for(i = 0;i < USTACKTOP;i += BY2PG) {
-			if(((*vpd)[VPN(i) /1024 ])!=0 && ((*vpt)[VPN(i)])!=0) {
-				duppage(newenvid, VPN(i));
+		// Pages with identical permissions are duplicated a run at a time.
+		// The child has an info page of its own already.
+		for(i = 0;i < USTACKTOP;) {
+			if(i == UINFO || ((*vpd)[VPN(i) /1024 ])==0 || ((*vpt)[VPN(i)])==0) {
+				i += BY2PG;
+				continue;
+			}
+			perm = (*vpt)[VPN(i)] & 0xfff;
+			for(n = 1; i + n*BY2PG < USTACKTOP; n++) {
+				pn = VPN(i) + n;
+				if(pn == VPN(UINFO) || ((*vpd)[pn /1024 ])==0 || ((*vpt)[pn] & 0xfff)!=perm ||
+				   ((*vpt)[pn])==0) {
+					break;
+				}
 			}
+			duppage(newenvid, VPN(i), n, perm);
+			i += n*BY2PG;
 		}
 		syscall_mem_alloc(newenvid, UXSTACKTOP - BY2PG, PTE_V|PTE_R|PTE_LIBRARY); //分配子进程的异常处理栈
 		syscall_set_pgfault_handler(newenvid, __asm_pgfault_handler, UXSTACKTOP); // 设置子进程的处理函数
@@ -84,6 +84,25 @@ fsipc_map(u_int fileid, u_int offset, u_int dstva)
 	return 0;
 }
 
+// Overview:
+//	Ask the file server to map the shared executable image of the open file
+//	`fileid` read-only at `dstva`, in place of mapping it block by block.
+//	The file must have been opened with O_EXEC.
+//
+// Returns:
+//	0 on success,
+//	< 0 on failure.
+int
+fsipc_map_exec(u_int fileid, u_int dstva)
+{
+	struct Fsreq_map_exec *req;
+
+	req = (struct Fsreq_map_exec *)fsipcbuf;
+	req->req_fileid = fileid;
+	req->req_dstva = dstva;
+	return fsipc(FSREQ_MAP_EXEC, req, 0, 0);
+}
+
 // Overview:
 //	Make a set-file-size request to the file server.
 int
@@ -42,3 +42,22 @@ ipc_recv(u_int *whom, u_int dstva, u_int *perm)
 	return env->env_ipc_value;
 }
 
+
+// Like ipc_recv, but give up after `ms` milliseconds.
+// Return 0 and store the value in *val, or -E_TIMEOUT if nothing came.
+int
+ipc_recv_timeout(u_int *whom, u_int dstva, u_int *perm, u_int *val, u_int ms)
+{
+	int r;
+
+	if ((r = syscall_ipc_recv_timeout(dstva, ms)) < 0)
+		return r;
+
+	if (whom)
+		*whom = env->env_ipc_from;
+	if (perm)
+		*perm = env->env_ipc_perm;
+	if (val)
+		*val = env->env_ipc_value;
+	return 0;
+}
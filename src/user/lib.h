@@ -7,12 +7,17 @@
 #include <env.h>
 #include <args.h>
 #include <unistd.h>
+#include <kclock.h>
+#include <trace.h>
+#include <prof.h>
 /////////////////////////////////////////////////////head
 extern void umain();
 extern void libmain();
 extern void exit();
 
 extern struct Env *env;
+extern struct Uinfo *uinfo;
+void uinfo_read(struct Uinfo *ui);
 
 
 #define USED(x) (void)(x)
@@ -53,6 +58,10 @@ int syscall_mem_alloc(u_int envid, u_int va, u_int perm);
 int syscall_mem_map(u_int srcid, u_int srcva, u_int dstid, u_int dstva,
 					u_int perm);
 int syscall_mem_unmap(u_int envid, u_int va);
+int syscall_mem_alloc_range(u_int envid, u_int va, u_int npages, u_int perm);
+int syscall_mem_map_range(u_int srcva, u_int dstid, u_int dstva,
+						  u_int npages, u_int perm);
+int syscall_mem_unmap_range(u_int envid, u_int va, u_int npages);
 
 inline static int syscall_env_alloc(void)
 {
@@ -64,9 +73,23 @@ int syscall_set_trapframe(u_int envid, struct Trapframe *tf);
 void syscall_panic(char *msg);
 int syscall_ipc_can_send(u_int envid, u_int value, u_int srcva, u_int perm);
 void syscall_ipc_recv(u_int dstva);
+int syscall_ipc_recv_timeout(u_int dstva, u_int ms);
+int syscall_sleep(u_int ms);
 int syscall_cgetc();
 int syscall_write_dev(u_int va,u_int dev,u_int offset);
 int syscall_read_dev(u_int va,u_int dev,u_int offset);
+int syscall_set_kernel_cow(u_int envid, u_int enable);
+int syscall_mem_region(u_int envid, u_int va, u_int npages, u_int perm);
+int syscall_set_stack_limit(u_int envid, u_int npages);
+int syscall_set_mem_limit(u_int envid, u_int npages);
+int syscall_mem_stat(u_int envid, struct Memstat *ms);
+int syscall_cpu_stat(u_int envid, struct Cpustat *cs);
+int syscall_trace_ctl(u_int op, struct Tracerec *buf, u_int n);
+int syscall_prof_ctl(u_int op, u_int arg, struct Profrec *buf, u_int n);
+int syscall_sys_stat(u_int envid, struct Sysstat *buf, u_int n);
+int syscall_batch(struct Sysbatch *b, u_int n);
+void batch_add(struct Sysbatch *b, u_int *n, u_int sysno, u_int a1, u_int a2,
+			   u_int a3, u_int a4, u_int a5);
 
 
 // string.c
@@ -78,6 +101,13 @@ int strcmp(const char *p, const char *q);
 // ipc.c
 void	ipc_send(u_int whom, u_int val, u_int srcva, u_int perm);
 u_int	ipc_recv(u_int *whom, u_int dstva, u_int *perm);
+int	ipc_recv_timeout(u_int *whom, u_int dstva, u_int *perm, u_int *val,
+					 u_int ms);
+
+// clock.c
+void	clock_now(u_int *sec, u_int *usec);
+u_int	clock_ms(void);
+u_int	clock_ticks(void);
 
 // wait.c
 void wait(u_int envid);
@@ -107,6 +137,7 @@ int	fsipc_close(u_int);
 int	fsipc_dirty(u_int, u_int);
 int	fsipc_remove(const char*);
 int	fsipc_sync(void);
+int	fsipc_map_exec(u_int, u_int);
 int	fsipc_incref(u_int);
 
 // fd.c
@@ -140,6 +171,7 @@ int	sync(void);
 #define	O_TRUNC		0x0200		/* truncate to zero length */
 #define	O_EXCL		0x0400		/* error if already exists */
 #define O_MKDIR		0x0800		/* create directory, not regular file */
+#define O_EXEC		0x1000		/* map the shared executable image */
 
 
 #endif
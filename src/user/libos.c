@@ -12,16 +12,26 @@ exit(void)
 
 struct Env *env;
 
+// Overview:
+//	Take a consistent copy of our info page (see struct Uinfo in env.h).
+void
+uinfo_read(struct Uinfo *ui)
+{
+	u_int seq;
+
+	do {
+		seq = uinfo->ui_seq;
+		*ui = *uinfo;
+	} while ((seq & 1) || seq != uinfo->ui_seq);
+}
+
 void
 libmain(int argc, char **argv)
 {
 	// set env to point at our env structure in envs[].
 	env = 0;	// Your code here.
 	//writef("xxxxxxxxx %x  %x  xxxxxxxxx\n",argc,(int)argv);
-	int envid;
-	envid = syscall_getenvid();
-	envid = ENVX(envid);
-	env = &envs[envid];
+	env = &envs[ENVX(uinfo->ui_envid)];
 	// call user main routine
 	umain(argc,argv);
 	// exit gracefully
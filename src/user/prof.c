@@ -0,0 +1,58 @@
+#include "lib.h"
+
+// Overview:
+//	Dump the sampling profile (see include/prof.h), one line per place an
+//	env was caught at: envid, pc, and the number of samples taken there.
+//	Sampling is stopped first. Given a file, the dump goes there instead
+//	of the console; src/readelf/profile.sh turns it into a flat profile
+//	of one program. With -s, start sampling afresh instead.
+
+struct Profrec recs[64];
+
+void
+usage(void)
+{
+	writef("usage: prof [-s] [file]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct Profrec *r;
+	int fd = 1, n, i, skip, dropped, start = 0;
+
+	ARGBEGIN{
+	default:
+		usage();
+	case 's':
+		start = 1;
+		break;
+	}ARGEND
+
+	if (argc > 1 || (start && argc > 0)) {
+		usage();
+	}
+	if (start) {
+		syscall_prof_ctl(PROF_START, 0, 0, 0);
+		return;
+	}
+
+	dropped = syscall_prof_ctl(PROF_STOP, 0, 0, 0);
+	if (argc == 1 && (fd = open(argv[0], O_WRONLY | O_CREAT | O_TRUNC)) < 0) {
+		user_panic("open %s: %e", argv[0], fd);
+	}
+
+	for (skip = 0; (n = syscall_prof_ctl(PROF_READ, skip, recs, 64)) > 0; skip += n) {
+		for (i = 0; i < n; i++) {
+			r = &recs[i];
+			fwritef(fd, "%08x %08x %d\n", r->pr_envid, r->pr_pc, r->pr_count);
+		}
+	}
+	if (dropped > 0) {
+		fwritef(fd, "# %d samples dropped\n", dropped);
+	}
+	if (fd != 1) {
+		close(fd);
+	}
+}
@@ -6,6 +6,7 @@
 #define debug 0
 #define TMPPAGE		(BY2PG)
 #define TMPPAGETOP	(TMPPAGE+BY2PG)
+#define SPAWN_NBATCH	16
 
 extern void __asm_pgfault_handler(void);
 int
@@ -75,10 +76,15 @@ init_stack(u_int child, char **argv, u_int *init_esp)
 	*init_esp = USTACKTOP - TMPPAGETOP + (u_int)pargv_ptr;
 //	*init_esp = USTACKTOP;	// Change this!
 
-	if ((r = syscall_mem_map(0, TMPPAGE, child, USTACKTOP-BY2PG, PTE_V|PTE_R)) < 0)
-		goto error;
-	if ((r = syscall_mem_unmap(0, TMPPAGE)) < 0)
+	struct Sysbatch b[2];
+	u_int nb = 0;
+
+	batch_add(b, &nb, SYS_mem_map, 0, TMPPAGE, child, USTACKTOP-BY2PG, PTE_V|PTE_R);
+	batch_add(b, &nb, SYS_mem_unmap, 0, TMPPAGE, 0, 0, 0);
+	if ((r = syscall_batch(b, nb)) != nb) {
+		r = r < 0 ? r : b[r].sb_ret;
 		goto error;
+	}
 
 	return 0;
 
@@ -99,46 +105,113 @@ int usr_is_elf_format(u_char *binary){
     return 0;
 }
 
+// Overview:
+//	Give the child a private copy of the file page at `blk`, keeping its
+//	first `len` bytes and zeroing the rest, mapped at `va` with `perm`.
+static int
+usr_copy_page(void *blk, u_int len, int child_envid, u_int va, u_int perm)
+{
+	int r;
+
+	if ((r = syscall_mem_alloc(0, TMPPAGE, PTE_V | PTE_R)) < 0) {
+		return r;
+	}
+	user_bcopy(blk, (void *)TMPPAGE, len);
+	user_bzero((u_char *)TMPPAGE + len, BY2PG - len);
+	if ((r = syscall_mem_map(0, TMPPAGE, child_envid, va, perm)) < 0) {
+		syscall_mem_unmap(0, TMPPAGE);
+		return r;
+	}
+	return syscall_mem_unmap(0, TMPPAGE);
+}
+
+// Overview:
+//	Map one PT_LOAD segment of the program open at `fd` into the child
+//	without copying it:
+//	- read-only segments share the file's cached pages read-only;
+//	- writable segments share them copy-on-write (resolved in the
+//	  kernel, see sys_set_kernel_cow);
+//	- bss is not allocated at all: it is registered as a demand-zero
+//	  region, and the child's first touch of a bss page faults in a
+//	  zeroed page.
+//	Only a page that mixes file data with bss is copied, so that the
+//	zeroed tail never lands in the file system's cache.
 int 
 usr_load_elf(int fd , Elf32_Phdr *ph, int child_envid){
-	//Hint: maybe this function is useful 
-	//      If you want to use this func, you should fill it ,it's not hard
-	
 	u_long va = ph->p_vaddr;
 	u_int sgsize = ph->p_memsz;
 	u_int bin_size = ph->p_filesz;
 	u_int off = ph->p_offset;
 
 	void *blk;
-	int i = 0;
+	u_int perm;
 	int r;
 
+	// The file is mapped page by page at fd2data(fd), so the pages backing
+	// the segment are contiguous there and can be shared in one call.
 	u_int offset = va - ROUNDDOWN(va, BY2PG);
-	i = i - offset;
-	for(; bin_size > BY2PG && i < bin_size - BY2PG; i+=BY2PG) {
-		r = read_map(fd, off+i, &blk);
-		if(r < 0) return r;
-		syscall_mem_map(0, blk, child_envid, va+i, PTE_V | PTE_R);
-	}
-	if(i < bin_size) {
-		r = read_map(fd, off+i, &blk);
-		u_int partial = bin_size - i;
-		if (partial > 0) {
-			user_bzero((u_char*)blk + partial, BY2PG - partial);
+	u_int fpages = bin_size ? ROUND(offset + bin_size, BY2PG) / BY2PG : 0;
+	u_int partial = (offset + bin_size) % BY2PG;
+	u_int mpages = ROUND(offset + sgsize, BY2PG) / BY2PG;
+
+	if (ph->p_flags & PF_W) {
+		perm = PTE_V | PTE_R | PTE_COW;
+	} else {
+		perm = PTE_V;
+	}
+
+	va = ROUNDDOWN(va, BY2PG);
+	if (mpages > fpages &&
+		(r = syscall_mem_region(child_envid, va + fpages * BY2PG,
+								mpages - fpages, PTE_V | PTE_R)) < 0) {
+		return r;
+	}
+	if (fpages == 0) {
+		return 0;
+	}
+	if ((r = read_map(fd, off - offset, &blk)) < 0) {
+		return r;
+	}
+
+	// The last page holds the start of bss: it needs a private copy.
+	if (partial > 0 && sgsize > bin_size) {
+		fpages--;
+		r = usr_copy_page((u_char *)blk + fpages * BY2PG, partial,
+						  child_envid, va + fpages * BY2PG,
+						  (ph->p_flags & PF_W) ? PTE_V | PTE_R : PTE_V);
+		if (r < 0) {
+			return r;
 		}
-		if(r < 0) return r;
-		syscall_mem_map(0, blk, child_envid, va+i, PTE_V | PTE_R);
-		i += BY2PG;
 	}
 
-	while(i < sgsize) {
-		syscall_mem_alloc(child_envid, va+i, PTE_V | PTE_R);
-		i += BY2PG;
+	if (fpages > 0 &&
+		(r = syscall_mem_map_range((u_int)blk, child_envid, va, fpages,
+								   perm)) < 0) {
+		return r;
 	}
 
 	return 0;
 }
 
+// Overview:
+//	Submit the `*n` syscalls queued in `batch` and empty it.
+//
+// Returns:
+//	0 on success, the first failing syscall's error otherwise.
+static int
+spawn_flush(struct Sysbatch *batch, u_int *n)
+{
+	int r;
+
+	r = syscall_batch(batch, *n);
+	if (r >= 0 && r < *n) {
+		writef("spawn: batched syscall %d failed\n", batch[r].sb_sysno);
+		r = batch[r].sb_ret;
+	}
+	*n = 0;
+	return r < 0 ? r : 0;
+}
+
 int spawn(char *prog, char **argv)
 {
 	// u_char elfbuf[512];
@@ -152,7 +225,7 @@ int spawn(char *prog, char **argv)
 	Elf32_Phdr* ph;
 	// Note 0: some variable may be not used,you can cancel them as you like
 	// Step 1: Open the file specified by `prog` (prog is the path of the program)
-	if((r=open(prog, O_RDONLY))<0){
+	if((r=open(prog, O_RDONLY | O_EXEC))<0){
 		user_panic("spawn ::open line 102 RDONLY wrong !\n");
 		return r;
 	}
@@ -163,6 +236,8 @@ int spawn(char *prog, char **argv)
 	// Step 2: Allocate an env (Hint: using syscall_env_alloc())
 	child_envid = syscall_env_alloc();
 	if(child_envid < 0) user_panic("[DEBUG] spawn: env_alloc failed!\n");
+	// The child inherited our demand-zero regions; it gets its own below.
+	syscall_mem_region(child_envid, 0, UTOP / BY2PG, 0);
 	// Step 3: Using init_stack(...) to initialize the stack of the allocated env
 	init_stack(child_envid, argv, &esp);
 	// Step 3: Map file's content to new env's text segment
@@ -201,42 +276,50 @@ int spawn(char *prog, char **argv)
 		ptr_ph_table += ph_entry_size;
 	}
 
+	// The child holds its own references to the pages it needs now.
+	close(fd);
+
 	struct Trapframe *tf;
 	writef("\n::::::::::spawn size : %x  sp : %x::::::::\n",size,esp);
 	tf = &(envs[ENVX(child_envid)].env_tf);
 	tf->pc = UTEXT;
 	tf->regs[29]=esp;
 
-	syscall_set_pgfault_handler(child_envid, __asm_pgfault_handler, UXSTACKTOP);	// !!!!! set the pgfault_handler for the son!!!
-	// Share memory
-	u_int pdeno = 0;
-	u_int pteno = 0;
+	// The remaining setup is many tiny syscalls: submit them as batches.
+	struct Sysbatch batch[SPAWN_NBATCH];
+	u_int nb = 0;
+
+	batch_add(batch, &nb, SYS_set_pgfault_handler, child_envid,
+			  (u_int)__asm_pgfault_handler, UXSTACKTOP, 0, 0);	// !!!!! set the pgfault_handler for the son!!!
+	// Writable segments are shared copy-on-write: let the kernel resolve them.
+	batch_add(batch, &nb, SYS_set_kernel_cow, child_envid, 1, 0, 0, 0);
+	// Share memory: hand every run of PTE_LIBRARY pages over in one call.
 	u_int pn = 0;
-	u_int va = 0;
-	for(pdeno = 0;pdeno<PDX(UTOP);pdeno++)
+	u_int run = 0;
+	for(pn = 0; pn <= VPN(UTOP); pn++)
 	{
-		if(!((* vpd)[pdeno]&PTE_V))
-			continue;
-		for(pteno = 0;pteno<=PTX(~0);pteno++)
+		if(pn < VPN(UTOP) && ((* vpd)[pn >> 10]&PTE_V) &&
+		   ((* vpt)[pn]&PTE_V) && ((* vpt)[pn]&PTE_LIBRARY))
 		{
-			pn = (pdeno<<10)+pteno;
-			if(((* vpt)[pn]&PTE_V)&&((* vpt)[pn]&PTE_LIBRARY))
-			{
-				va = pn*BY2PG;
-
-				if((r = syscall_mem_map(0,va,child_envid,va,(PTE_V|PTE_R|PTE_LIBRARY)))<0)
-				{
-
-					writef("va: %x   child_envid: %x   \n",va,child_envid);
-					user_panic("@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@");
-					return r;
-				}
-			}
+			run++;
+			continue;
 		}
+		if(run == 0) {
+			if(!((* vpd)[pn >> 10]&PTE_V))
+				pn |= PTX(~0);		// skip the rest of an empty page table
+			continue;
+		}
+		if(nb == SPAWN_NBATCH && (r = spawn_flush(batch, &nb)) < 0)
+			return r;
+		batch_add(batch, &nb, SYS_mem_map_range, (pn - run)*BY2PG, child_envid,
+				  (pn - run)*BY2PG, run, (PTE_V|PTE_R|PTE_LIBRARY));
+		run = 0;
 	}
 
-
-	if((r = syscall_set_env_status(child_envid, ENV_RUNNABLE)) < 0)
+	if(nb == SPAWN_NBATCH && (r = spawn_flush(batch, &nb)) < 0)
+		return r;
+	batch_add(batch, &nb, SYS_set_env_status, child_envid, ENV_RUNNABLE, 0, 0, 0);
+	if((r = spawn_flush(batch, &nb)) < 0)
 	{
 		writef("set child runnable is wrong\n");
 		return r;
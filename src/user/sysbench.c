@@ -0,0 +1,57 @@
+#include "lib.h"
+
+// Overview:
+//	Time the null syscall: SYS_getenvid, trapping every time. It is a
+//	leaf syscall and takes the fast path through handle_sys; run this on
+//	a kernel built with -DSYS_LEAF_MASK=0 as well to time the same call
+//	the full way, saving and restoring the whole trapframe. Last comes
+//	syscall_getenvid, which reads the info page and does not trap at all.
+//	Times are CPU time of this env, as SYS_cpu_stat counts it.
+
+static u_int
+cpu_us(void)
+{
+	struct Cpustat cs;
+
+	syscall_cpu_stat(0, &cs);
+	return cs.cs_sec * 1000000 + cs.cs_usec;
+}
+
+static void
+report(char *what, u_int n, u_int us)
+{
+	writef("%-24s %d calls, %d us, %d.%03d us/call\n", what, n, us,
+		   us / n, (us % n) * 1000 / n);
+}
+
+void
+umain(int argc, char **argv)
+{
+	u_int i, n = 10000, us;
+	char *p;
+
+	if (argc > 2) {
+		writef("usage: sysbench [ncalls]\n");
+		return;
+	}
+	if (argc == 2) {
+		for (n = 0, p = argv[1]; *p >= '0' && *p <= '9'; p++) {
+			n = n * 10 + *p - '0';
+		}
+		if (n == 0) {
+			n = 1;
+		}
+	}
+
+	us = cpu_us();
+	for (i = 0; i < n; i++) {
+		msyscall(SYS_getenvid, 0, 0, 0, 0, 0);
+	}
+	report("getenvid (trap)", n, cpu_us() - us);
+
+	us = cpu_us();
+	for (i = 0; i < n; i++) {
+		syscall_getenvid();
+	}
+	report("info page (no trap)", n, cpu_us() - us);
+}
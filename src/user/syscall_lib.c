@@ -10,10 +10,11 @@ void syscall_putchar(char ch)
 }
 
 
+// Our envid never changes, so the info page has it without a trap.
 u_int
 syscall_getenvid(void)
 {
-	return msyscall(SYS_getenvid, 0, 0, 0, 0, 0);
+	return uinfo->ui_envid;
 }
 
 void
@@ -52,6 +53,25 @@ syscall_mem_unmap(u_int envid, u_int va)
 	return msyscall(SYS_mem_unmap, envid, va, 0, 0, 0);
 }
 
+int
+syscall_mem_alloc_range(u_int envid, u_int va, u_int npages, u_int perm)
+{
+	return msyscall(SYS_mem_alloc_range, envid, va, npages, perm, 0);
+}
+
+int
+syscall_mem_map_range(u_int srcva, u_int dstid, u_int dstva, u_int npages,
+					  u_int perm)
+{
+	return msyscall(SYS_mem_map_range, srcva, dstid, dstva, npages, perm);
+}
+
+int
+syscall_mem_unmap_range(u_int envid, u_int va, u_int npages)
+{
+	return msyscall(SYS_mem_unmap_range, envid, va, npages, 0, 0);
+}
+
 int
 syscall_set_env_status(u_int envid, u_int status)
 {
@@ -82,6 +102,18 @@ syscall_ipc_recv(u_int dstva)
 	msyscall(SYS_ipc_recv, dstva, 0, 0, 0, 0);
 }
 
+int
+syscall_ipc_recv_timeout(u_int dstva, u_int ms)
+{
+	return msyscall(SYS_ipc_recv, dstva, ms, 0, 0, 0);
+}
+
+int
+syscall_sleep(u_int ms)
+{
+	return msyscall(SYS_sleep, ms, 0, 0, 0, 0);
+}
+
 int
 syscall_cgetc()
 {
@@ -96,3 +128,78 @@ int syscall_read_dev(u_int va,u_int dev,u_int offset)
 {
     return msyscall(SYS_read_dev, va , dev , offset ,0,0);
 }
+
+int
+syscall_set_kernel_cow(u_int envid, u_int enable)
+{
+	return msyscall(SYS_set_kernel_cow, envid, enable, 0, 0, 0);
+}
+
+int
+syscall_mem_region(u_int envid, u_int va, u_int npages, u_int perm)
+{
+	return msyscall(SYS_mem_region, envid, va, npages, perm, 0);
+}
+
+int
+syscall_set_stack_limit(u_int envid, u_int npages)
+{
+	return msyscall(SYS_set_stack_limit, envid, npages, 0, 0, 0);
+}
+
+int
+syscall_set_mem_limit(u_int envid, u_int npages)
+{
+	return msyscall(SYS_set_mem_limit, envid, npages, 0, 0, 0);
+}
+
+int
+syscall_mem_stat(u_int envid, struct Memstat *ms)
+{
+	return msyscall(SYS_mem_stat, envid, (int)ms, 0, 0, 0);
+}
+
+int
+syscall_cpu_stat(u_int envid, struct Cpustat *cs)
+{
+	return msyscall(SYS_cpu_stat, envid, (int)cs, 0, 0, 0);
+}
+
+int
+syscall_trace_ctl(u_int op, struct Tracerec *buf, u_int n)
+{
+	return msyscall(SYS_trace_ctl, op, (int)buf, n, 0, 0);
+}
+
+int
+syscall_prof_ctl(u_int op, u_int arg, struct Profrec *buf, u_int n)
+{
+	return msyscall(SYS_prof_ctl, op, arg, (int)buf, n, 0);
+}
+
+int
+syscall_sys_stat(u_int envid, struct Sysstat *buf, u_int n)
+{
+	return msyscall(SYS_sys_stat, envid, (int)buf, n, 0, 0);
+}
+
+int
+syscall_batch(struct Sysbatch *b, u_int n)
+{
+	return msyscall(SYS_batch, (int)b, n, 0, 0, 0);
+}
+
+// Append one syscall record to the batch `b`, which holds `*n` records.
+void
+batch_add(struct Sysbatch *b, u_int *n, u_int sysno, u_int a1, u_int a2,
+		  u_int a3, u_int a4, u_int a5)
+{
+	b += (*n)++;
+	b->sb_sysno = sysno;
+	b->sb_args[0] = a1;
+	b->sb_args[1] = a2;
+	b->sb_args[2] = a3;
+	b->sb_args[3] = a4;
+	b->sb_args[4] = a5;
+	b->sb_ret = 0;
+}
@@ -0,0 +1,85 @@
+#include "lib.h"
+
+// Overview:
+//	Print the syscall counts (see SYS_sys_stat) of the whole system, or of
+//	the env whose id is given in hex: for each syscall made, the number of
+//	calls, their average time in microseconds, and how many took under
+//	1, 4, 16, ... microseconds.
+
+static char *sys_names[] = {
+	"putchar", "getenvid", "yield", "env_destroy", "set_pgfault_handler",
+	"mem_alloc", "mem_map", "mem_unmap", "env_alloc", "set_env_status",
+	"set_trapframe", "panic", "ipc_can_send", "ipc_recv", "cgetc",
+	"write_dev", "read_dev", "set_kernel_cow", "mem_alloc_range",
+	"mem_map_range", "mem_unmap_range", "batch", "mem_region",
+	"set_stack_limit", "set_mem_limit", "mem_stat", "sleep", "cpu_stat",
+	"trace_ctl", "prof_ctl", "sys_stat",
+};
+
+struct Sysstat stats[__NR_SYSCALLS];
+
+void
+usage(void)
+{
+	writef("usage: sysstat [envid]\n");
+	exit();
+}
+
+static u_int
+hex(char *s)
+{
+	u_int v = 0;
+
+	for (; *s; s++) {
+		if (*s >= '0' && *s <= '9') {
+			v = v * 16 + *s - '0';
+		} else if (*s >= 'a' && *s <= 'f') {
+			v = v * 16 + *s - 'a' + 10;
+		} else {
+			usage();
+		}
+	}
+	return v;
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct Sysstat *s;
+	u_int envid = SYSSTAT_ALL, timed;
+	int n, i, j;
+
+	ARGBEGIN{
+	default:
+		usage();
+	}ARGEND
+
+	if (argc > 1) {
+		usage();
+	}
+	if (argc == 1) {
+		envid = hex(argv[0]);
+	}
+	if ((n = syscall_sys_stat(envid, stats, __NR_SYSCALLS)) < 0) {
+		user_panic("sys_stat %x: %e", envid, n);
+	}
+
+	writef("%-20s %8s %8s  <1us <4 <16 <64 <256 <1ms <4ms more\n",
+		   "syscall", "calls", "avg us");
+	for (i = 0; i < n; i++) {
+		s = &stats[i];
+		if (s->ss_count == 0) {
+			continue;
+		}
+		// Timed calls: those that returned to the caller.
+		for (j = 0, timed = 0; j < SYSSTAT_NBUCKET; j++) {
+			timed += s->ss_hist[j];
+		}
+		writef("%-20s %8d %8d ", i < sizeof(sys_names) / sizeof(sys_names[0]) ?
+			   sys_names[i] : "?", s->ss_count, timed ? s->ss_usec / timed : 0);
+		for (j = 0; j < SYSSTAT_NBUCKET; j++) {
+			writef(" %d", s->ss_hist[j]);
+		}
+		writef("\n");
+	}
+}
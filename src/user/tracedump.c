@@ -0,0 +1,65 @@
+#include "lib.h"
+
+// Overview:
+//	Dump the kernel event trace (see include/trace.h), one event per line:
+//	time in microseconds, event, env, and the two arguments of the event.
+//	Recording is stopped first, so the dump does not trace itself. Given
+//	a file, the dump goes there instead of the console, for looking at it
+//	elsewhere. With -s, start recording afresh instead.
+
+static char *trace_names[] = {
+	"?", "switch", "block", "wake", "send", "recv", "fault", "syscall",
+};
+#define NNAMES	(sizeof(trace_names) / sizeof(trace_names[0]))
+
+struct Tracerec recs[64];
+
+void
+usage(void)
+{
+	writef("usage: tracedump [-s] [file]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct Tracerec *r;
+	int fd = 1, n, i, start = 0;
+
+	ARGBEGIN{
+	default:
+		usage();
+	case 's':
+		start = 1;
+		break;
+	}ARGEND
+
+	if (argc > 1 || (start && argc > 0)) {
+		usage();
+	}
+	if (start) {
+		syscall_trace_ctl(TRACE_START, 0, 0);
+		return;
+	}
+
+	syscall_trace_ctl(TRACE_STOP, 0, 0);
+	if (argc == 1 && (fd = open(argv[0], O_WRONLY | O_CREAT | O_TRUNC)) < 0) {
+		user_panic("open %s: %e", argv[0], fd);
+	}
+
+	while ((n = syscall_trace_ctl(TRACE_READ, recs, 64)) > 0) {
+		for (i = 0; i < n; i++) {
+			r = &recs[i];
+			fwritef(fd, "%10u %-7s %08x %08x %08x\n", r->tr_usec,
+					trace_names[r->tr_type < NNAMES ? r->tr_type : 0],
+					r->tr_envid, r->tr_arg[0], r->tr_arg[1]);
+		}
+	}
+	if ((n = syscall_trace_ctl(TRACE_LOST, 0, 0)) > 0) {
+		fwritef(fd, "# %d earlier events lost\n", n);
+	}
+	if (fd != 1) {
+		close(fd);
+	}
+}